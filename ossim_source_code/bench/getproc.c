@@ -0,0 +1,92 @@
+/*
+ * Dispatch cost of the policies, bench/getproc.c
+ *
+ * Queues [nr] processes on one CPU, spread over all MAX_PRIO levels,
+ * then has the CPU take the next one with get_proc() and put it back
+ * with put_proc() [rounds] times. Prints the cost of one get+put pair
+ * for each policy and each number of queued processes. The scheduler is
+ * set up once per process, so every case runs in a child of its own.
+ *
+ *	make bench && ./bench/getproc [rounds] [policy...]
+ */
+
+#include "common.h"
+#include "sched.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+static const char * default_policies[] = {
+	"fifo", "rr", "mlq", "cfs", "mlfq", "srtf"
+};
+static const int queued[] = { 1, 16, 140, 1000 };
+
+/* Cost in ns of one get_proc() and put_proc() with [nr] processes */
+static double run_case(const char * policy, int nr, long rounds) {
+	struct code_seg_t code = { .text = NULL, .size = 1000 };
+	struct pcb_t * procs = calloc(nr, sizeof(struct pcb_t));
+	struct timespec start, end;
+	long r;
+	int i;
+
+	set_scheduler(policy);
+	sched_set_time_slot(2);
+	init_scheduler(1);
+	for (i = 0; i < nr; i++) {
+		procs[i].pid = i + 1;
+		procs[i].code = &code;
+		procs[i].prio = i % MAX_PRIO;
+		procs[i].last_cpu = -1;
+		add_proc(&procs[i]);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (r = 0; r < rounds; r++) {
+		struct pcb_t * proc = get_proc(0);
+		if (proc == NULL) {
+			exit(1);
+		}
+		put_proc(0, proc);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	return ((end.tv_sec - start.tv_sec) * 1e9
+		+ end.tv_nsec - start.tv_nsec) / rounds;
+}
+
+int main(int argc, char * argv[]) {
+	long rounds = argc > 1 ? atol(argv[1]) : 1000000;
+	int nr_policies = argc > 2 ? argc - 2
+		: sizeof(default_policies) / sizeof(default_policies[0]);
+	int i, j;
+
+	printf("ns per get_proc + put_proc, %ld rounds\n", rounds);
+	printf("%-6s", "policy");
+	for (j = 0; j < sizeof(queued) / sizeof(queued[0]); j++) {
+		printf(" %7d", queued[j]);
+	}
+	printf("\n");
+	fflush(stdout);
+	for (i = 0; i < nr_policies; i++) {
+		const char * policy = argc > 2 ? argv[i + 2]
+			: default_policies[i];
+		if (set_scheduler(policy) != 0) {
+			fprintf(stderr, "Unknown policy %s\n", policy);
+			return 1;
+		}
+		printf("%-6s", policy);
+		fflush(stdout);
+		for (j = 0; j < sizeof(queued) / sizeof(queued[0]); j++) {
+			pid_t child = fork();
+			if (child == 0) {
+				printf(" %7.1f", run_case(policy, queued[j],
+						rounds));
+				exit(0);
+			}
+			waitpid(child, NULL, 0);
+		}
+		printf("\n");
+	}
+	return 0;
+}
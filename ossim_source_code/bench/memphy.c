@@ -0,0 +1,82 @@
+/*
+ * Frame allocator of MEMPHY, bench/memphy.c
+ *
+ * For devices of 1 MiB up to 256 MiB (or the sizes given, in MiB) times
+ * init_memphy(), which formats the free frame stack and bitmap, then
+ * getting and putting back every frame one at a time (what a page fault
+ * does to the swap and an exit to RAM) and all of them at once with
+ * MEMPHY_get_freefps() (what growing an area does).
+ *
+ *	make bench && ./bench/memphy [MiB...]
+ */
+
+#include "mm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define ROUNDS 20
+
+static const int default_mib[] = { 1, 16, 256 };
+
+static double elapsed_ns(struct timespec * start) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) * 1e9
+		+ now.tv_nsec - start->tv_nsec;
+}
+
+int main(int argc, char * argv[]) {
+	int nr_cases = argc > 1 ? argc - 1
+		: sizeof(default_mib) / sizeof(default_mib[0]);
+	int c;
+
+	printf("%8s %9s %11s %16s %16s\n", "device", "frames", "format",
+		"get+put/frame", "bulk get/frame");
+	for (c = 0; c < nr_cases; c++) {
+		int mib = argc > 1 ? atoi(argv[c + 1]) : default_mib[c];
+		struct memphy_struct mp;
+		struct timespec start;
+		double format_ns, single_ns, bulk_ns;
+		int * fpns;
+		int nr, r, i;
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		if (init_memphy(&mp, mib << 20, 1) != 0) {
+			return 1;
+		}
+		format_ns = elapsed_ns(&start);
+		nr = mp.maxfp;
+		fpns = malloc(nr * sizeof(int));
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (r = 0; r < ROUNDS; r++) {
+			for (i = 0; i < nr; i++) {
+				MEMPHY_get_freefp(&mp, &fpns[i]);
+			}
+			for (i = 0; i < nr; i++) {
+				MEMPHY_put_freefp(&mp, fpns[i]);
+			}
+		}
+		single_ns = elapsed_ns(&start) / ((double)ROUNDS * nr);
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (r = 0; r < ROUNDS; r++) {
+			if (MEMPHY_get_freefps(&mp, nr, fpns) != 0) {
+				return 1;
+			}
+			for (i = 0; i < nr; i++) {
+				MEMPHY_put_freefp(&mp, fpns[i]);
+			}
+		}
+		bulk_ns = elapsed_ns(&start) / ((double)ROUNDS * nr);
+
+		printf("%5d MiB %9d %8.2f ms %13.1f ns %13.1f ns\n", mib, nr,
+			format_ns / 1e6, single_ns, bulk_ns);
+		free(fpns);
+		free(mp.storage);
+		free(mp.free_fpn);
+		free(mp.used_fp);
+	}
+	return 0;
+}
@@ -0,0 +1,85 @@
+/*
+ * Page replacement policies, bench/pgrepl.c
+ *
+ * Replays the same reference string against every policy of mm-repl.c:
+ * a process owning [frames] frames (64 by default) touches a hot set of
+ * 32 pages 80% of the time and scans 256 other pages cyclically the rest
+ * of the time, [refs] references in all (1M by default). Prints the
+ * faults and evictions of each policy and the cost per reference of its
+ * bookkeeping (pg_admit, pg_access, find_victim_page).
+ *
+ *	make bench && ./bench/pgrepl [frames] [refs]
+ */
+
+#include "mm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define HOT_PAGES 32
+#define SCAN_PAGES 256
+#define SCAN_BASE 1024
+
+static const char * policies[] = { "fifo", "clock", "lru", "lfu" };
+
+static double elapsed_ns(struct timespec * start) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) * 1e9
+		+ now.tv_nsec - start->tv_nsec;
+}
+
+int main(int argc, char * argv[]) {
+	int frames = argc > 1 ? atoi(argv[1]) : 64;
+	long refs = argc > 2 ? atol(argv[2]) : 1000000;
+	static char resident[PAGING_MAX_PGN];
+	int i;
+
+	printf("%d frames, %ld references, %d%% to %d hot pages\n",
+		frames, refs, 80, HOT_PAGES);
+	printf("%-6s %10s %10s %10s\n", "policy", "faults", "evictions",
+		"ns/ref");
+	for (i = 0; i < sizeof(policies) / sizeof(policies[0]); i++) {
+		struct pcb_t proc;
+		struct mm_struct mm;
+		struct timespec start;
+		long faults = 0, evictions = 0, r;
+		int nr_resident = 0, scan = 0;
+
+		memset(&proc, 0, sizeof(proc));
+		memset(resident, 0, sizeof(resident));
+		set_pgrepl(policies[i]);
+		init_mm(&mm, &proc);
+		/* Same reference string for every policy */
+		srand(1);
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (r = 0; r < refs; r++) {
+			int pgn = rand() % 10 < 8 ? rand() % HOT_PAGES
+				: SCAN_BASE + scan++ % SCAN_PAGES;
+
+			if (!resident[pgn]) {
+				faults++;
+				if (nr_resident == frames) {
+					int victim;
+					if (find_victim_page(&mm, &victim) != 0) {
+						return 1;
+					}
+					resident[victim] = 0;
+					nr_resident--;
+					evictions++;
+				}
+				if (pg_admit(&mm, pgn) != 0) {
+					return 1;
+				}
+				resident[pgn] = 1;
+				nr_resident++;
+			}
+			pg_access(&mm, pgn);
+		}
+		printf("%-6s %10ld %10ld %10.1f\n", policies[i], faults,
+			evictions, elapsed_ns(&start) / refs);
+		free_pgtbl(&mm);
+	}
+	return 0;
+}
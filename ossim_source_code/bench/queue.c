@@ -0,0 +1,118 @@
+/*
+ * Ready queue, bench/queue.c
+ *
+ * Keeps [nr] processes queued and times dequeue() followed by enqueue()
+ * of the same process with a new random priority, for 10, 1k and 100k
+ * queued processes. The heap of queue.c is compared with the linear scan
+ * it replaced (highest priority found by a scan, then the tail shifted
+ * down), kept below as a reference.
+ *
+ *	make bench && ./bench/queue [nr...]
+ */
+
+#include "queue.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static const int default_nr[] = { 10, 1000, 100000 };
+
+/* The queue as it was before the heap, grown to hold [nr] processes */
+struct scan_queue {
+	struct pcb_t ** proc;
+	int size;
+};
+
+static void scan_enqueue(struct scan_queue * q, struct pcb_t * proc) {
+	q->proc[q->size++] = proc;
+}
+
+static struct pcb_t * scan_dequeue(struct scan_queue * q) {
+	int highest = 0;
+	int i;
+	if (q->size == 0) {
+		return NULL;
+	}
+	for (i = 0; i < q->size; i++) {
+		if (q->proc[i]->priority > q->proc[highest]->priority) {
+			highest = i;
+		}
+	}
+	struct pcb_t * proc = q->proc[highest];
+	for (i = highest + 1; i < q->size; i++) {
+		q->proc[i - 1] = q->proc[i];
+	}
+	q->size--;
+	return proc;
+}
+
+static double elapsed_ns(struct timespec * start) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) * 1e9
+		+ now.tv_nsec - start->tv_nsec;
+}
+
+int main(int argc, char * argv[]) {
+	int nr_cases = argc > 1 ? argc - 1
+		: sizeof(default_nr) / sizeof(default_nr[0]);
+	int c;
+
+	printf("ns per dequeue + enqueue\n");
+	printf("%8s %10s %12s %10s\n", "queued", "rounds", "linear scan",
+		"heap");
+	for (c = 0; c < nr_cases; c++) {
+		int nr = argc > 1 ? atoi(argv[c + 1]) : default_nr[c];
+		/* About the same time for every size with the scan */
+		long rounds = 10000000L / nr;
+		struct pcb_t * procs = calloc(nr, sizeof(struct pcb_t));
+		struct scan_queue scan = {
+			.proc = malloc(nr * sizeof(struct pcb_t*)), .size = 0
+		};
+		struct queue_t heap = { .heap = NULL, .size = 0 };
+		struct timespec start;
+		double scan_ns, heap_ns;
+		long r;
+		int i;
+
+		if (rounds < 100) {
+			rounds = 100;
+		}
+		if (rounds > 1000000) {
+			rounds = 1000000;
+		}
+
+		srand(1);
+		for (i = 0; i < nr; i++) {
+			procs[i].priority = rand() % MAX_PRIO;
+			scan_enqueue(&scan, &procs[i]);
+		}
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (r = 0; r < rounds; r++) {
+			struct pcb_t * proc = scan_dequeue(&scan);
+			proc->priority = rand() % MAX_PRIO;
+			scan_enqueue(&scan, proc);
+		}
+		scan_ns = elapsed_ns(&start) / rounds;
+
+		srand(1);
+		for (i = 0; i < nr; i++) {
+			procs[i].priority = rand() % MAX_PRIO;
+			enqueue(&heap, &procs[i]);
+		}
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (r = 0; r < rounds; r++) {
+			struct pcb_t * proc = dequeue(&heap);
+			proc->priority = rand() % MAX_PRIO;
+			enqueue(&heap, proc);
+		}
+		heap_ns = elapsed_ns(&start) / rounds;
+
+		printf("%8d %10ld %12.1f %10.1f\n", nr, rounds, scan_ns,
+			heap_ns);
+		free(heap.heap);
+		free(scan.proc);
+		free(procs);
+	}
+	return 0;
+}
@@ -0,0 +1,73 @@
+#!/bin/sh
+#
+# Simulation engines, bench/sim.sh
+#
+# Runs ./os on each config with the threaded engine (one thread per CPU
+# in lockstep with the timer), the single-threaded event engine and the
+# worker pool, and prints the best wall time of [runs] runs of each.
+# "same" counts the threaded runs whose sorted output matches the event
+# engine's (the statistics after "Scheduler statistics" aside), "w=N" the
+# runs of a pool of N workers that do. A single worker steps the devices
+# in the order of the event engine and must always match. Several host
+# threads may step CPUs that compete for the same run queue in a slot in
+# any order, so the schedule itself may then vary from run to run.
+#
+#	make && ./bench/sim.sh [runs] [config...]
+#
+# Configs are names under input/, cpus_256 and sparse_arrival by default.
+
+runs=${1:-3}
+[ $# -gt 0 ] && shift
+configs=${*:-"sched cpus_256 sparse_arrival"}
+tmp=${TMPDIR:-/tmp}/ossim-bench.$$
+trap 'rm -f $tmp.*' EXIT
+
+summary() {
+	sed '/^Scheduler statistics/,$d' $tmp.$1 | sort
+}
+
+# best_time [engine] [config]: best wall time in seconds of [runs] runs.
+# Runs matching the event engine's output are counted in $tmp.same
+best_time() {
+	best=
+	same=0
+	i=0
+	while [ $i -lt $runs ]; do
+		start=$(date +%s.%N)
+		./os --sim=$1 $2 > $tmp.$1
+		end=$(date +%s.%N)
+		best=$(echo "$start $end $best" | awk '{ t = $2 - $1;
+			if ($3 != "" && $3 < t) t = $3; printf "%.3f", t }')
+		[ "$(summary $1)" = "$(cat $tmp.ref)" ] && same=$((same + 1))
+		i=$((i + 1))
+	done
+	echo $same > $tmp.same
+	echo $best
+}
+
+# same_runs [workers] [config]: runs of a pool of [workers] matching the
+# event engine's output
+same_runs() {
+	same=0
+	i=0
+	while [ $i -lt $runs ]; do
+		./os --sim=pool --workers=$1 $2 > $tmp.pool
+		[ "$(summary pool)" = "$(cat $tmp.ref)" ] && same=$((same + 1))
+		i=$((i + 1))
+	done
+	echo $same/$runs
+}
+
+printf "%-16s %9s %9s %9s %6s %6s %6s %6s\n" config thread event pool same \
+	w=1 w=2 w=3
+for config in $configs; do
+	./os --sim=event $config > $tmp.event
+	summary event > $tmp.ref
+	event=$(best_time event $config)
+	pool=$(best_time pool $config)
+	thread=$(best_time thread $config)
+	same=$(cat $tmp.same)/$runs
+	printf "%-16s %8ss %8ss %8ss %6s %6s %6s %6s\n" $config $thread \
+		$event $pool $same $(same_runs 1 $config) $(same_runs 2 $config) \
+		$(same_runs 3 $config)
+done
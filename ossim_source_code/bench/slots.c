@@ -0,0 +1,94 @@
+/*
+ * Slot barrier of the timer, bench/slots.c
+ *
+ * Attaches [cpus] devices that do nothing but call next_slot() for
+ * [slots] time slots, and prints the time slots per second the timer
+ * gets through. The timer only runs once per process, so every device
+ * count is measured in a child of its own. bench/slots is built with the
+ * sense-reversing barrier, bench/slots-condvar with the per-device
+ * condvar handshake (TIMER_CONDVAR).
+ *
+ *	make bench && ./bench/slots [slots] [cpus...]
+ */
+
+#include "timer.h"
+#include "os-cfg.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+static const int default_cpus[] = { 1, 2, 4, 8, 16, 32, 64, 128, 256 };
+
+static int nr_slots;
+
+static void * device_routine(void * args) {
+	struct timer_id_t * timer_id = (struct timer_id_t*)args;
+	int slot;
+	for (slot = 0; slot < nr_slots; slot++) {
+		next_slot(timer_id);
+	}
+	detach_event(timer_id);
+	return NULL;
+}
+
+/* Run the timer with [cpus] devices, return the time it took in s */
+static double run_slots(int cpus) {
+	pthread_t * devices = malloc(cpus * sizeof(pthread_t));
+	struct timer_id_t ** ids = malloc(cpus * sizeof(struct timer_id_t*));
+	struct timespec start, end;
+	int i;
+
+	for (i = 0; i < cpus; i++) {
+		ids[i] = attach_event();
+	}
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	start_timer();
+	for (i = 0; i < cpus; i++) {
+		pthread_create(&devices[i], NULL, device_routine, ids[i]);
+	}
+	for (i = 0; i < cpus; i++) {
+		pthread_join(devices[i], NULL);
+	}
+	stop_timer();
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	free(devices);
+	free(ids);
+	return end.tv_sec - start.tv_sec + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+int main(int argc, char * argv[]) {
+	int nr_cpus = argc > 2 ? argc - 2
+		: sizeof(default_cpus) / sizeof(default_cpus[0]);
+	int i;
+
+	nr_slots = argc > 1 ? atoi(argv[1]) : 5000;
+#ifdef TIMER_SENSE_BARRIER
+	printf("sense-reversing barrier, %d slots\n", nr_slots);
+#else
+	printf("condvar handshake, %d slots\n", nr_slots);
+#endif
+	printf("%6s %12s\n", "cpus", "slots/s");
+	fflush(stdout);
+	for (i = 0; i < nr_cpus; i++) {
+		int cpus = argc > 2 ? atoi(argv[i + 2]) : default_cpus[i];
+		int out = dup(STDOUT_FILENO);
+		pid_t child = fork();
+
+		if (child == 0) {
+			/* The timer prints every slot, keep only the result */
+			int null = open("/dev/null", O_WRONLY);
+			dup2(null, STDOUT_FILENO);
+			double seconds = run_slots(cpus);
+			fflush(stdout);
+			dup2(out, STDOUT_FILENO);
+			printf("%6d %12.0f\n", cpus, nr_slots / seconds);
+			exit(0);
+		}
+		close(out);
+		waitpid(child, NULL, 0);
+	}
+	return 0;
+}
@@ -0,0 +1,67 @@
+/*
+ * Swap bandwidth, bench/swapcp.c
+ *
+ * Copies [pages] pages (2M by default) from a 1 MiB RAM to a 16 MiB swap
+ * and prints the pages per second of the byte loop __swap_cp_page used
+ * to be (kept below as a reference), of MEMPHY_copy_page() and of
+ * __swap_cp_page() as the swap path calls it.
+ *
+ *	make bench && ./bench/swapcp [pages]
+ */
+
+#include "mm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define RAM_SZ 0x100000
+#define SWP_SZ 0x1000000
+
+/* A page a byte at a time, as before the page-granular calls */
+static int byte_cp_page(struct memphy_struct * mpsrc, int srcfpn,
+		struct memphy_struct * mpdst, int dstfpn) {
+	int cellidx;
+	for (cellidx = 0; cellidx < PAGING_PAGESZ; cellidx++) {
+		BYTE data;
+		MEMPHY_read(mpsrc, srcfpn * PAGING_PAGESZ + cellidx, &data);
+		MEMPHY_write(mpdst, dstfpn * PAGING_PAGESZ + cellidx, data);
+	}
+	return 0;
+}
+
+static const struct {
+	const char * name;
+	int (*copy)(struct memphy_struct * mpsrc, int srcfpn,
+			struct memphy_struct * mpdst, int dstfpn);
+} copies[] = {
+	{ "byte loop (old)", byte_cp_page },
+	{ "MEMPHY_copy_page", MEMPHY_copy_page },
+	{ "__swap_cp_page", __swap_cp_page },
+};
+
+int main(int argc, char * argv[]) {
+	long pages = argc > 1 ? atol(argv[1]) : 2000000;
+	struct memphy_struct ram, swp;
+	int ram_fp = RAM_SZ / PAGING_PAGESZ;
+	int swp_fp = SWP_SZ / PAGING_PAGESZ;
+	int c;
+
+	init_memphy(&ram, RAM_SZ, 1);
+	init_memphy(&swp, SWP_SZ, 1);
+	printf("%ld pages of %d bytes, RAM to swap\n", pages, PAGING_PAGESZ);
+	printf("%-18s %12s\n", "copy", "Mpages/s");
+	for (c = 0; c < sizeof(copies) / sizeof(copies[0]); c++) {
+		struct timespec start, end;
+		long i;
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (i = 0; i < pages; i++) {
+			copies[c].copy(&ram, i % ram_fp, &swp, i % swp_fp);
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		printf("%-18s %12.2f\n", copies[c].name, pages / 1e6
+			/ (end.tv_sec - start.tv_sec
+				+ (end.tv_nsec - start.tv_nsec) / 1e9));
+	}
+	return 0;
+}
@@ -0,0 +1,52 @@
+#!/bin/sh
+#
+# Opt-in models, bench/variants.sh
+#
+# os-cfg.h leaves some scheduler models off so the plain schedules are
+# kept. make bench also builds the OS with each of them turned on,
+# bench/os-[variant]. Each variant runs next to ./os in event mode on a
+# config it is meant for, and one figure of the report it must lower is
+# compared. Exits with 1 if a variant does not lower its figure.
+#
+#	make && make bench && ./bench/variants.sh
+
+tmp=${TMPDIR:-/tmp}/ossim-variants.$$
+trap 'rm -f $tmp.*' EXIT
+status=0
+
+# figure [section] [row] [field]: field [field] of the first line starting
+# with [row] after the line starting with [section] in $tmp.out
+figure() {
+	awk -v section="$1" -v row="$2" -v field=$3 '
+		index($0, section) == 1 { on = 1 }
+		on && $1 == row { print $field; exit }' $tmp.out
+}
+
+# compare [variant] [config] [name] [section] [row] [field]: figure
+# [name] of ./os and of bench/os-[variant] on [config]
+compare() {
+	variant=$1
+	config=$2
+	name=$3
+	shift 3
+	./os --sim=event $config > $tmp.out
+	plain=$(figure "$@")
+	./bench/os-$variant --sim=event $config > $tmp.out
+	opted=$(figure "$@")
+	verdict=ok
+	if [ -z "$opted" ] || [ -z "$plain" ] || [ "$opted" -ge "$plain" ]; then
+		verdict=FAIL
+		status=1
+	fi
+	printf "%-10s %-18s %-14s %8s %8s  %s\n" $variant "$config" "$name" \
+		"$plain" "$opted" $verdict
+}
+
+printf "%-10s %-18s %-14s %8s %8s\n" variant config figure ./os variant
+# Affinity-aware picks keep round-robin processes on their CPU
+compare affinity "--sched=rr sched" migrations "Cache affinity" all 5
+# Aged level-1 processes no longer wait behind the flood at level 0
+compare aging mlq_aging "p99 response" "Process metrics" all 10
+# Longer quanta on lightly loaded CPUs save put/dispatch round trips
+compare quantum cpus_256 dispatches "Cache affinity" all 2
+exit $status
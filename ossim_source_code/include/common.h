@@ -89,6 +89,28 @@ struct pcb_t {
 #endif
 	struct page_table_t * page_table; // Page table
 	uint32_t bp;	// Break pointer
+	struct pcb_t * rq_next;	// Link in the lock-free inbox of a run queue
+	/* MLQ waiters of its group, oldest first, for aging */
+	struct pcb_t * wait_prev;
+	struct pcb_t * wait_next;
+	uint64_t wait_since;	// Slot it was queued in
+	int q_index;	// Position in the heap of the ready queue holding it
+	uint64_t vruntime;	// Weighted CPU time, completely-fair policy
+	int mlfq_level;		// Feedback queue level, 0 is the top
+	int mlfq_used;		// Slots used of the allotment of that level
+	uint64_t mlfq_epoch;	// Boost period the level was set in
+	/* Scheduling metrics, in time slots */
+	uint64_t arrival;	// Loaded
+	uint64_t first_run;	// First dispatched, SLOT_NEVER before
+	uint64_t finish;	// Found finished
+	uint64_t run_slots;	// Spent running
+	int last_cpu;		// CPU it last ran on, -1 before
+	uint64_t last_run;	// Slot it last ran in
+	int cur_cpu;		// CPU running it, set before each run()
+	/* Real-time parameters, see sched-edf.c */
+	uint64_t deadline;	// Absolute deadline, 0 if not real-time
+	uint32_t period;	// Period for admission control
+	int group;		// Fair-share group, see sched-group.c
 
 };
 
@@ -0,0 +1,33 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include "common.h"
+
+/*
+ * Per-process scheduling metrics
+ *
+ * Every process is stamped with its arrival, first dispatch and finish
+ * slots. finish_metrics() summarizes turnaround (finish - arrival),
+ * response (first dispatch - arrival) and waiting (turnaround - slots
+ * spent running) times over all processes, per priority level and per
+ * CPU the process finished on. Per CPU it also counts dispatches,
+ * context switches, migrations and the slots lost refilling cold caches.
+ */
+
+void init_metrics(int num_cpus);
+
+/* [proc] has just been found finished on CPU [cpu] */
+void record_metrics(int cpu, struct pcb_t * proc);
+
+/* [proc] is dispatched on CPU [cpu] and must first refill its cache for
+ * [refill] slots. Call before [proc] runs there */
+void record_dispatch(int cpu, struct pcb_t * proc, int refill);
+
+/* CPU [cpu] was busy for one time slot */
+void record_busy_slot(int cpu);
+
+/* Print the summary table, and write it to [csv] too if it is not NULL */
+void finish_metrics(const char * csv);
+
+#endif
+
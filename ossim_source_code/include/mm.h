@@ -4,8 +4,9 @@
 #include "common.h"
 #include <pthread.h>
 
-static pthread_mutex_t ram_lock;
-static pthread_mutex_t swap_lock;
+/* Serialize the accesses to the RAM and to the swap (mm-vm.c) */
+extern pthread_mutex_t ram_lock;
+extern pthread_mutex_t swap_lock;
 /* CPU Bus definition */
 #define PAGING_CPU_BUS_WIDTH 22 /* 22bit bus - MAX SPACE 4MB */
 #define PAGING_PAGESZ  256      /* 256B or 8-bits PAGE NUMBER */
@@ -16,6 +17,16 @@ static pthread_mutex_t swap_lock;
 #define PAGING_SWPFPN_OFFSET 5  
 #define PAGING_MAX_PGN  (DIV_ROUND_UP(BIT(PAGING_CPU_BUS_WIDTH),PAGING_PAGESZ))
 
+/* Two-level page table: [pgd] holds PAGING_PGD_SZ pointers to leaf tables
+ * of PAGING_PTBL_SZ PTEs, both allocated on the first mapping under them.
+ * A leaf table is followed by one word per page for the page replacement
+ * policy, see pg_meta() */
+#define PAGING_PTBL_BITS 8
+#define PAGING_PTBL_SZ BIT(PAGING_PTBL_BITS)
+#define PAGING_PGD_SZ (DIV_ROUND_UP(PAGING_MAX_PGN,PAGING_PTBL_SZ))
+#define PAGING_PGD_IDX(pgn) ((pgn) >> PAGING_PTBL_BITS)
+#define PAGING_PTBL_IDX(pgn) ((pgn) & (PAGING_PTBL_SZ - 1))
+
 #define PAGING_SBRK_INIT_SZ PAGING_PAGESZ
 /* PTE BIT */
 #define PAGING_PTE_PRESENT_MASK BIT(31) 
@@ -112,6 +123,10 @@ int alloc_pages_range(struct pcb_t *caller, int incpgnum, struct framephy_struct
 int __swap_cp_page(struct memphy_struct *mpsrc, int srcfpn,
                 struct memphy_struct *mpdst, int dstfpn) ;
 int pte_set_fpn(uint32_t *pte, int fpn);
+uint32_t pte_get(struct mm_struct *mm, int pgn);
+uint32_t *pte_alloc(struct mm_struct *mm, int pgn);
+uint32_t *pg_meta(struct mm_struct *mm, int pgn);
+void free_pgtbl(struct mm_struct *mm);
 int pte_set_swap(uint32_t *pte, int swptyp, int swpoff);
 int init_pte(uint32_t *pte,
              int pre,    // present
@@ -146,13 +161,27 @@ int validate_overlap_vm_area(struct pcb_t *caller, int vmaid, int vmastart, int
 int get_free_vmrg_area(struct pcb_t *caller, int vmaid, int size, struct vm_rg_struct *newrg);
 int inc_vma_limit(struct pcb_t *caller, int vmaid, int inc_sz, int* inc_limit_ret);
 int find_victim_page(struct mm_struct* mm, int *pgn);
+int swap_out_victim(struct pcb_t *caller, int *retfpn);
+int free_pcb_memph(struct pcb_t *caller);
+
+/* Page replacement policy, mm-repl.c */
+int set_pgrepl(const char *name);
+int pg_admit(struct mm_struct *mm, int pgn);
+void pg_access(struct mm_struct *mm, int pgn);
+void pgrepl_count_fault(void);
+void finish_pgrepl(void);
 struct vm_area_struct *get_vma_by_num(struct mm_struct *mm, int vmaid);
 
 /* MEM/PHY protypes */
 int MEMPHY_get_freefp(struct memphy_struct *mp, int *fpn);
+int MEMPHY_get_freefps(struct memphy_struct *mp, int nr, int *fpns);
 int MEMPHY_put_freefp(struct memphy_struct *mp, int fpn);
 int MEMPHY_read(struct memphy_struct * mp, int addr, BYTE *value);
 int MEMPHY_write(struct memphy_struct * mp, int addr, BYTE data);
+int MEMPHY_read_page(struct memphy_struct *mp, int fpn, BYTE *buf);
+int MEMPHY_write_page(struct memphy_struct *mp, int fpn, const BYTE *buf);
+int MEMPHY_copy_page(struct memphy_struct *mpsrc, int srcfpn,
+                     struct memphy_struct *mpdst, int dstfpn);
 int MEMPHY_dump(struct memphy_struct * mp);
 int init_memphy(struct memphy_struct *mp, int max_size, int randomflg);
 /* DEBUG */
@@ -3,10 +3,90 @@
 
 #define MLQ_SCHED 1
 #define MAX_PRIO 140
+#define SCHED_STATS 1
+
+/* MLQ aging: a waiting process climbs all MAX_PRIO levels in MLQ_AGING
+ * slots, it starts over from its [prio] once dispatched. 0, the default,
+ * disables it, bench/os-aging is built with -DMLQ_AGING=64.
+ * Waits are histogrammed per level in MLQ_WAIT_BUCKETS power-of-two
+ * buckets */
+#ifndef MLQ_AGING
+#define MLQ_AGING 0
+#endif
+#define MLQ_WAIT_BUCKETS 12
+
+/* MLQ quantum per level: one time slot of the config for level 0 up to
+ * MLQ_QUANTUM_SCALE time slots for the least urgent one. With
+ * MLQ_QUANTUM_ADAPT a CPU doubles the quantum of a level, up to
+ * 2^MLQ_QUANTUM_ADAPT times, while it expires with nothing else waiting
+ * and resets it once something does. 1 and 0, the defaults, keep the
+ * time slot of the config for every level. bench/os-quantum is built
+ * with -DMLQ_QUANTUM_SCALE=4 -DMLQ_QUANTUM_ADAPT=2 */
+#ifndef MLQ_QUANTUM_SCALE
+#define MLQ_QUANTUM_SCALE 1
+#endif
+#ifndef MLQ_QUANTUM_ADAPT
+#define MLQ_QUANTUM_ADAPT 0
+#endif
+
+/* Completely-fair policy (--sched=cfs), [prio] acts as the nice level.
+ * The slice is CFS_SCHED_LATENCY time slots shared by the runnable
+ * processes in proportion to their weight, at least CFS_MIN_GRANULARITY */
+#define CFS_SCHED_LATENCY 12
+#define CFS_MIN_GRANULARITY 1
+
+/* Multi-level feedback policy (--sched=mlfq): level l runs for
+ * MLFQ_QUANTUM << l slots, everything is boosted back to level 0 every
+ * MLFQ_BOOST_PERIOD slots */
+#define MLFQ_LEVELS 8
+#define MLFQ_QUANTUM 4
+#define MLFQ_BOOST_PERIOD 64
+
+/* Shortest-remaining-time policy (--sched=srtf): a waiting process earns
+ * one instruction of credit every SRTF_AGING slots, 0 disables aging */
+#define SRTF_AGING 64
+
+/* Real-time processes (a deadline on their config line) that do not fit
+ * in the CPUs are deferred until they do, or rejected if undefined */
+#define EDF_ADMISSION_DEFER
+
+/* Fair-share groups (a "group [name] [shares]" line of the config): up to
+ * SCHED_MAX_GROUPS groups, processes declared before any group line get
+ * SCHED_GROUP_SHARES. Usage is reported per SCHED_GROUP_WINDOW slots */
+#define SCHED_MAX_GROUPS 16
+#define SCHED_GROUP_SHARES 1024
+#define SCHED_GROUP_WINDOW 16
+
+/* Cache warmth: a process stays hot on the CPU it last ran on for
+ * CACHE_HOT_SLOTS time slots. Dispatched anywhere it is not hot, it first
+ * spends CACHE_REFILL_PENALTY slots refilling the cache. Schedulers pass
+ * over processes hot on another CPU, up to CACHE_AFFINITY_SCAN deep. Both
+ * 0 turn the model off and keep the plain schedule, it is opted into by
+ * building with -DCACHE_REFILL_PENALTY=1 -DCACHE_AFFINITY_SCAN=4 as
+ * bench/os-affinity is */
+#define CACHE_HOT_SLOTS 8
+#ifndef CACHE_REFILL_PENALTY
+#define CACHE_REFILL_PENALTY 0
+#endif
+#ifndef CACHE_AFFINITY_SCAN
+#define CACHE_AFFINITY_SCAN 0
+#endif
+
+/* Slot barrier of the timer: sense-reversing spin/futex barrier.
+ * Undefine, or build with -DTIMER_CONDVAR, to fall back to the
+ * per-device condvar handshake */
+#ifndef TIMER_CONDVAR
+#define TIMER_SENSE_BARRIER
+#endif
+#define BARRIER_SPIN 128
 
 #define MM_PAGING
 #define MM_PAGING_HEAP_GODOWN
 #define MM_FIXED_MEMSZ
+/* Per-CPU TLB of MM_TLB_SETS sets of MM_TLB_WAYS entries, see tlb.h */
+#define MM_TLB
+#define MM_TLB_SETS 16
+#define MM_TLB_WAYS 4
 //#define VMDBG 1
 //#define MMDBG 1
 #define IODUMP 1
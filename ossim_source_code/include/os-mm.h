@@ -1,6 +1,8 @@
 #ifndef OSMM_H
 #define OSMM_H
 
+#include <sys/types.h>
+
 #define MM_PAGING
 #define PAGING_MAX_MMSWP 5 /* max number of supported swapped space */
 #define PAGING_MAX_SYMTBL_SZ 30
@@ -14,6 +16,18 @@ struct pgn_t{
    struct pgn_t *pg_next; 
 };
 
+/*
+ *  Resident pages of a process, oldest first, in a growable ring
+ */
+struct pg_ring {
+   int *pgn;
+   int head;
+   int size;
+   int cap;
+   unsigned long nr_access;  // Accesses so far, the aging clock of lru
+   unsigned long aged;       // [nr_access] when pages were last aged
+};
+
 /*
  *  Memory region struct
  */
@@ -48,15 +62,15 @@ struct vm_area_struct {
  * Memory management struct
  */
 struct mm_struct {
-   uint32_t *pgd;
+   uint32_t **pgd;   // Leaf page tables, see PAGING_PGD_SZ
 
    struct vm_area_struct *mmap;
 
    /* Currently we support a fixed number of symbol */
    struct vm_rg_struct symrgtbl[PAGING_MAX_SYMTBL_SZ];
 
-   /* list of free page */
-   struct pgn_t *fifo_pgn;
+   /* Pages the replacement policy may evict, see mm-repl.c */
+   struct pg_ring resident;
 };
 
 /*
@@ -79,9 +93,13 @@ struct memphy_struct {
    int rdmflg;
    int cursor;
 
-   /* Management structure */
-   struct framephy_struct *free_fp_list;
-   struct framephy_struct *used_fp_list;
+   /* Frame allocator: free frame numbers are popped from and pushed on
+    * [free_fpn], a bit per frame in [used_fp] tells which are handed out */
+   int *free_fpn;
+   int nr_free;
+   int maxfp;
+   unsigned long *used_fp;
+   pthread_mutex_t fp_lock;
 };
 
 #endif
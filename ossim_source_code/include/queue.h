@@ -4,20 +4,52 @@
 
 #include "common.h"
 
+/* Initial capacity, queues grow on demand and never drop a process */
 #define MAX_QUEUE_SIZE 10
 
+/* Heap key of enqueue(): the highest [priority] comes out first */
+#define QUEUE_PRIO_KEY(priority) ((uint64_t)UINT32_MAX - (priority))
+
+struct queue_node {
+	uint64_t key;	// Smallest key is dequeued first
+	uint64_t seq;	// Enqueue order, breaks ties between equal keys
+	struct pcb_t * proc;
+};
+
 struct queue_t {
-	struct pcb_t * proc[MAX_QUEUE_SIZE];
+	struct queue_node * heap;
 	int size;
+	int capacity;
+	uint64_t seq;
 
 	int slot;
 };
 
 void enqueue(struct queue_t * q, struct pcb_t * proc);
 
+/* Enqueue [proc] ordered by [key] instead of its priority */
+void enqueue_key(struct queue_t * q, struct pcb_t * proc, uint64_t key);
+
 struct pcb_t * dequeue(struct queue_t * q);
 
+/* Next process dequeue() would return, without removing it */
+struct pcb_t * queue_peek(struct queue_t * q);
+
+/* Among the first [depth] heap slots of [q], the earliest enqueued process
+ * whose key ties with the head and for which [match] holds, or NULL */
+struct pcb_t * queue_find(struct queue_t * q, int depth,
+		int (*match)(struct pcb_t * proc, int arg), int arg);
+
+/* Remove [proc], which must be queued in [q] */
+void queue_remove(struct queue_t * q, struct pcb_t * proc);
+
+/* Change the key of [proc], which must be queued in [q] */
+void queue_set_key(struct queue_t * q, struct pcb_t * proc, uint64_t key);
+
 int empty(struct queue_t * q);
 
+/* Number of processes enqueue() failed to store */
+unsigned long queue_dropped(void);
+
 #endif
 
@@ -1,7 +1,12 @@
-#ifndef QUEUE_H
-#define QUEUE_H
+#ifndef SCHED_H
+#define SCHED_H
 
 #include "common.h"
+/* Not <pthread.h>, which includes this header back as <sched.h> */
+#include <sys/types.h>
+#ifdef SCHED_STATS
+#include <time.h>
+#endif
 
 #ifndef MLQ_SCHED
 #define MLQ_SCHED
@@ -9,20 +14,134 @@
 
 //#define MAX_PRIO 139
 
+/*
+ * Scheduling policy
+ *
+ * Every policy is a table of operations; set_scheduler() picks one by
+ * name before init_scheduler() and the calls below go through it.
+ */
+struct sched_class {
+	const char * name;
+	void (*init)(int num_cpus);
+	/* Next process for CPU [cpu], NULL if there is none */
+	struct pcb_t * (*get)(int cpu);
+	/* [proc] used up its quantum on CPU [cpu] */
+	void (*put)(int cpu, struct pcb_t * proc);
+	/* [proc] has just been loaded */
+	void (*add)(struct pcb_t * proc);
+	/* 1 if no process is waiting */
+	int (*empty)(void);
+	/* Optional, see sched_quantum() */
+	int (*quantum)(int cpu, struct pcb_t * proc);
+	/* Optional, see sched_tick() */
+	void (*tick)(int cpu, struct pcb_t * proc);
+	/* Optional, set up the policy state of a newly loaded [proc] before
+	 * it is queued or handed over to a CPU */
+	void (*prepare)(struct pcb_t * proc);
+	/* Optional, print policy specific statistics */
+	void (*report)(void);
+	/* Optional, urgency of [proc] for preemption, lower is more
+	 * urgent. [prio] when not set */
+	uint32_t (*rank)(struct pcb_t * proc);
+};
+
+extern const struct sched_class fifo_sched_class;
+extern const struct sched_class rr_sched_class;
+extern const struct sched_class mlq_sched_class;
+extern const struct sched_class cfs_sched_class;	// sched-cfs.c
+extern const struct sched_class mlfq_sched_class;	// sched-mlfq.c
+extern const struct sched_class srtf_sched_class;	// sched-srtf.c
+/* Real-time class, always runs ahead of the selected one (sched-edf.c) */
+extern const struct sched_class edf_sched_class;
+
+/* Admission control of the real-time [proc]: 1 if admitted, -1 if it
+ * must be retried later (with [retry] set), 0 if rejected */
+int edf_admit(struct pcb_t * proc, int retry);
+/* Release the utilization of the finished real-time [proc], count a miss
+ * if it finished late */
+void edf_finish(int cpu, struct pcb_t * proc);
+/* A real-time process with an earlier deadline than the running [proc]
+ * is queued */
+int edf_preempts(struct pcb_t * proc);
+
+/* Fair-share groups (sched-group.c). Declare group [name] with [shares]
+ * before init_scheduler(), return its id (the one it already has if
+ * declared twice) or -1 if there are too many, [shares] is 0 or [name]
+ * is longer than 15 characters. Group 0 is the default one */
+int sched_add_group(const char * name, unsigned int shares);
+int sched_nr_groups(void);
+/* Virtual time of [group]: the slots it used scaled by its shares */
+uint64_t group_vtime(int group);
+void init_groups(int num_cpus);
+/* [proc] was added, has finished, ran one slot on CPU [cpu] */
+void group_enter(struct pcb_t * proc);
+void group_exit(struct pcb_t * proc);
+void group_charge(int cpu, struct pcb_t * proc);
+void report_groups(void);
+
+/* Select the policy called [name], return -1 if there is none */
+int set_scheduler(const char * name);
+const char * scheduler_name(void);
+
+/* Run queue lock which accounts its hold time to the CPU taking it,
+ * cpu < 0 stands for the loader */
+struct sched_lock {
+	pthread_mutex_t mutex;
+#ifdef SCHED_STATS
+	struct timespec start;
+#endif
+};
+
+void sched_lock_init(struct sched_lock * lock);
+void sched_lock(struct sched_lock * lock, int cpu);
+void sched_unlock(struct sched_lock * lock, int cpu);
+
+/* Also time how long the run queue locks are held. The times vary from
+ * run to run, so they are left out of the report unless asked for */
+void sched_set_lock_times(int on);
+
+/* Let a newly added process preempt a less urgent running one */
+void sched_set_preempt(int on);
+
+/* Time slot of the config, policies may scale their quanta from it */
+void sched_set_time_slot(int slot);
+
+/* CPU [cpu] must yield its process at this slot boundary */
+int sched_need_resched(int cpu);
+
+/* CPU [cpu] took a process from the run queue of another CPU */
+void sched_count_steal(int cpu);
+
+/* The cache of CPU [cpu] still holds [proc]: it last ran there at most
+ * CACHE_HOT_SLOTS time slots ago */
+int sched_cache_hot(struct pcb_t * proc, int cpu);
+
+/* 1 if no process is waiting in any run queue */
 int queue_empty(void);
 
-void init_scheduler(void);
+void init_scheduler(int num_cpus);
 void finish_scheduler(void);
 
-/* Get the next process from ready queue */
-struct pcb_t * get_proc(void);
+/* Get the next process for CPU [cpu] */
+struct pcb_t * get_proc(int cpu);
 
-/* Put a process back to run queue */
-void put_proc(struct pcb_t * proc);
+/* Put a process back after it used up its quantum on CPU [cpu] */
+void put_proc(int cpu, struct pcb_t * proc);
 
-/* Add a new process to ready queue */
+/* Add a newly loaded process */
 void add_proc(struct pcb_t * proc);
 
-#endif
+/* [proc] has finished on CPU [cpu] */
+void sched_exit(int cpu, struct pcb_t * proc);
 
+/* Number of time slots [proc] may run once dispatched on CPU [cpu],
+ * 0 means the time slot of the config. A real-time process may run all
+ * its remaining instructions */
+int sched_quantum(int cpu, struct pcb_t * proc);
 
+/* [proc] has run one time slot on CPU [cpu], or spent it refilling the
+ * cache if [refill] is set: then only its group is charged, the slot does
+ * not count against its quantum */
+void sched_tick(int cpu, struct pcb_t * proc, int refill);
+
+#endif
@@ -4,9 +4,21 @@
 #include <pthread.h>
 #include <stdint.h>
 
+#define SLOT_NEVER UINT64_MAX
+
+/* Parking state of a device, see park_event() */
+#define EVENT_RUNNING 0
+#define EVENT_PARKING 1
+#define EVENT_PARKED 2
+#define EVENT_WAKING 3	// Being re-attached by unpark_event()
+#define EVENT_WOKEN 4	// Unparked into the slot it was woken in
+
 struct timer_id_t {
 	int done;
 	int fsh;
+	int sense;	// Local sense of the slot barrier
+	int parked;	// Parking state, EVENT_RUNNING when attached
+	uint64_t wake;	// Slot the device is idle until
 	pthread_cond_t event_cond;
 	pthread_mutex_t event_lock;
 	pthread_cond_t timer_cond;
@@ -23,6 +35,34 @@ void detach_event(struct timer_id_t * event);
 
 void next_slot(struct timer_id_t* timer_id);
 
+/* Same as next_slot() but tells the timer that this device has nothing
+ * to do before time slot [wake]. When every attached device is idle the
+ * timer jumps directly to the earliest wake-up. SLOT_NEVER means the
+ * device only reacts to other devices */
+void next_idle_slot(struct timer_id_t* timer_id, uint64_t wake);
+
+/* Same as next_idle_slot(timer_id, SLOT_NEVER), except that the device
+ * parks if [can_park]() still holds once it is marked as parking: it
+ * leaves the slot barrier and the timer stops waiting for it. Return once
+ * unpark_event() let it run again, either still in the slot it was
+ * unparked in or from the next one. Without TIMER_SENSE_BARRIER devices
+ * never park */
+void park_event(struct timer_id_t * timer_id, int (*can_park)(void));
+
+/* Let device [timer_id] run again if it is parked or parking. A parked
+ * device runs the rest of the current slot if [this_slot] is set, else it
+ * runs from the next slot on, as one still parking always does. Only an
+ * attached device may call it, while it runs its slot */
+void unpark_event(struct timer_id_t * timer_id, int this_slot);
+
+/* Number of devices parked or parking */
+int parked_events(void);
+
+/* Clock of the single-threaded engine, which steps the devices itself
+ * instead of attaching them: print the empty slots up to [slot], then
+ * [slot] itself, and make it the current time */
+void announce_slot(uint64_t slot);
+
 uint64_t current_time();
 
 #endif
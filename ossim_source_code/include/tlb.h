@@ -0,0 +1,35 @@
+#ifndef TLB_H
+#define TLB_H
+
+#include <stdint.h>
+
+/*
+ * Per-CPU translation lookaside buffer
+ *
+ * Every CPU caches page table entries in its own MM_TLB_SETS x MM_TLB_WAYS
+ * set-associative TLB, least recently used entry evicted first. Entries
+ * are tagged with the address-space ID of their process, its PID, so a
+ * context switch does not flush anything. Changing or dropping a mapping
+ * must shoot the page down on every CPU.
+ */
+
+void init_tlb(int num_cpus);
+
+/* Look [pgn] of address space [asid] up in the TLB of CPU [cpu]. Return 0
+ * and set [pte] on a hit, -1 on a miss */
+int tlb_lookup(int cpu, uint32_t asid, int pgn, uint32_t * pte);
+
+/* Cache [pte] of [pgn] in the TLB of CPU [cpu] after a page table walk */
+void tlb_fill(int cpu, uint32_t asid, int pgn, uint32_t pte);
+
+/* The mapping of [pgn] changed, drop it from every TLB */
+void tlb_shootdown(uint32_t asid, int pgn);
+
+/* Drop every entry of address space [asid], e.g. when it goes away */
+void tlb_flush_asid(uint32_t asid);
+
+/* Print hits, misses and shootdowns per CPU, then release the TLBs */
+void finish_tlb(void);
+
+#endif
+
@@ -0,0 +1,241 @@
+
+#include "metrics.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+struct proc_record {
+	uint32_t pid;
+	uint32_t prio;
+	int cpu;
+	uint64_t turnaround;
+	uint64_t response;
+	uint64_t waiting;
+};
+
+/* Records are kept per CPU so that CPUs never contend for them */
+struct record_list {
+	struct proc_record * recs;
+	int size;
+	int capacity;
+	unsigned long nr_dispatches;
+	unsigned long nr_switches;	// Dispatched another process than the last
+	uint32_t last_pid;
+	unsigned long nr_migrations;	// Dispatched away from its last CPU
+	unsigned long nr_cold;		// Dispatched with a cold cache
+	unsigned long refill_slots;
+	unsigned long busy_slots;
+};
+
+static struct record_list * metrics;
+static int metrics_nr_cpus;
+
+void init_metrics(int num_cpus) {
+	metrics_nr_cpus = num_cpus;
+	metrics = (struct record_list*)calloc(num_cpus,
+			sizeof(struct record_list));
+}
+
+void record_metrics(int cpu, struct pcb_t * proc) {
+	struct record_list * list = &metrics[cpu];
+	if (list->size == list->capacity) {
+		int capacity = list->capacity ? 2 * list->capacity : 64;
+		struct proc_record * recs = (struct proc_record*)realloc(
+				list->recs, capacity * sizeof(struct proc_record));
+		if (recs == NULL) {
+			printf("[RECORD_METRICS] Error: out of memory, "
+				"process %d not recorded\n", proc->pid);
+			return;
+		}
+		list->recs = recs;
+		list->capacity = capacity;
+	}
+	struct proc_record * rec = &list->recs[list->size++];
+	rec->pid = proc->pid;
+#ifdef MLQ_SCHED
+	rec->prio = proc->prio;
+#else
+	rec->prio = proc->priority;
+#endif
+	rec->cpu = cpu;
+	rec->turnaround = proc->finish - proc->arrival;
+	rec->response = proc->first_run - proc->arrival;
+	rec->waiting = rec->turnaround - proc->run_slots;
+}
+
+void record_dispatch(int cpu, struct pcb_t * proc, int refill) {
+	struct record_list * list = &metrics[cpu];
+	list->nr_dispatches++;
+	if (proc->pid != list->last_pid) {
+		list->nr_switches++;
+	}
+	list->last_pid = proc->pid;
+	if (proc->last_cpu >= 0 && proc->last_cpu != cpu) {
+		list->nr_migrations++;
+	}
+	if (refill > 0) {
+		list->nr_cold++;
+		list->refill_slots += refill;
+	}
+}
+
+void record_busy_slot(int cpu) {
+	metrics[cpu].busy_slots++;
+}
+
+/* Dispatches, context switches per 1000 busy slots, migrations and the
+ * share of busy slots spent refilling */
+static void report_affinity(void) {
+	struct record_list all = { 0 };
+	int cpu;
+	printf("Cache affinity (refill penalty %d)\n", CACHE_REFILL_PENALTY);
+	printf("\t%3s %10s %8s %7s %10s %8s %8s %10s %7s\n", "CPU",
+		"dispatches", "switches", "per 1k", "migrations", "cold",
+		"refill", "busy", "lost");
+	for (cpu = 0; cpu <= metrics_nr_cpus; cpu++) {
+		struct record_list * list = &metrics[cpu];
+		if (cpu < metrics_nr_cpus) {
+			printf("\t%3d", cpu);
+			all.nr_dispatches += list->nr_dispatches;
+			all.nr_switches += list->nr_switches;
+			all.nr_migrations += list->nr_migrations;
+			all.nr_cold += list->nr_cold;
+			all.refill_slots += list->refill_slots;
+			all.busy_slots += list->busy_slots;
+		}else{
+			list = &all;
+			printf("\t%3s", "all");
+		}
+		printf(" %10lu %8lu %7.1f %10lu %8lu %8lu %10lu %6.2f%%\n",
+			list->nr_dispatches, list->nr_switches,
+			list->busy_slots ?
+			1000.0 * list->nr_switches / list->busy_slots : 0.0,
+			list->nr_migrations, list->nr_cold,
+			list->refill_slots, list->busy_slots,
+			list->busy_slots ?
+			100.0 * list->refill_slots / list->busy_slots : 0.0);
+	}
+}
+
+static int cmp_slots(const void * a, const void * b) {
+	uint64_t x = *(const uint64_t *)a;
+	uint64_t y = *(const uint64_t *)b;
+	return (x > y) - (x < y);
+}
+
+/* Nearest-rank percentile of the [n] sorted [vals] */
+static uint64_t percentile(uint64_t * vals, int n, int p) {
+	int rank = (p * n + 99) / 100;
+	return vals[rank > 0 ? rank - 1 : 0];
+}
+
+enum { GROUP_ALL, GROUP_PRIO, GROUP_CPU };
+
+static const char * group_names[] = { "all", "prio", "cpu" };
+
+static int in_group(struct proc_record * rec, int group, int id) {
+	switch (group) {
+	case GROUP_PRIO:
+		return rec->prio == id;
+	case GROUP_CPU:
+		return rec->cpu == id;
+	}
+	return 1;
+}
+
+/* Print one row of the summary, and of [csv]. Return 0 if the group is
+ * empty */
+static int report_group(FILE * csv, int group, int id, uint64_t * vals[3]) {
+	int n = 0;
+	int cpu, i, m;
+	for (cpu = 0; cpu < metrics_nr_cpus; cpu++) {
+		for (i = 0; i < metrics[cpu].size; i++) {
+			struct proc_record * rec = &metrics[cpu].recs[i];
+			if (!in_group(rec, group, id)) {
+				continue;
+			}
+			vals[0][n] = rec->turnaround;
+			vals[1][n] = rec->response;
+			vals[2][n] = rec->waiting;
+			n++;
+		}
+	}
+	if (n == 0) {
+		return 0;
+	}
+
+	if (group == GROUP_ALL) {
+		printf("\t%-4s %4s %6d", group_names[group], "", n);
+	} else {
+		printf("\t%-4s %4d %6d", group_names[group], id, n);
+	}
+	if (csv != NULL) {
+		fprintf(csv, "%s,%d,%d", group_names[group],
+			group == GROUP_ALL ? -1 : id, n);
+	}
+	for (m = 0; m < 3; m++) {
+		qsort(vals[m], n, sizeof(uint64_t), cmp_slots);
+		printf(" |%6lu %6lu %6lu", percentile(vals[m], n, 50),
+			percentile(vals[m], n, 95), percentile(vals[m], n, 99));
+		if (csv != NULL) {
+			fprintf(csv, ",%lu,%lu,%lu", percentile(vals[m], n, 50),
+				percentile(vals[m], n, 95),
+				percentile(vals[m], n, 99));
+		}
+	}
+	printf("\n");
+	if (csv != NULL) {
+		fprintf(csv, "\n");
+	}
+	return 1;
+}
+
+void finish_metrics(const char * csv) {
+	int total = 0;
+	int cpu, prio, m;
+	for (cpu = 0; cpu < metrics_nr_cpus; cpu++) {
+		total += metrics[cpu].size;
+	}
+
+	FILE * file = NULL;
+	if (csv != NULL && (file = fopen(csv, "w")) == NULL) {
+		printf("[FINISH_METRICS] Error: cannot open %s\n", csv);
+	}
+	if (file != NULL) {
+		fprintf(file, "group,id,n,"
+			"turnaround_p50,turnaround_p95,turnaround_p99,"
+			"response_p50,response_p95,response_p99,"
+			"waiting_p50,waiting_p95,waiting_p99\n");
+	}
+
+	uint64_t * vals[3];
+	for (m = 0; m < 3; m++) {
+		vals[m] = (uint64_t*)malloc((total + 1) * sizeof(uint64_t));
+	}
+
+	printf("Process metrics (time slots)\n");
+	printf("\t%-4s %4s %6s |%20s |%20s |%20s\n", "", "", "",
+		"turnaround", "response", "waiting");
+	printf("\t%-4s %4s %6s |%6s %6s %6s |%6s %6s %6s |%6s %6s %6s\n",
+		"grp", "id", "n", "p50", "p95", "p99",
+		"p50", "p95", "p99", "p50", "p95", "p99");
+	report_group(file, GROUP_ALL, 0, vals);
+	for (prio = 0; prio < MAX_PRIO; prio++) {
+		report_group(file, GROUP_PRIO, prio, vals);
+	}
+	for (cpu = 0; cpu < metrics_nr_cpus; cpu++) {
+		report_group(file, GROUP_CPU, cpu, vals);
+	}
+	report_affinity();
+
+	for (m = 0; m < 3; m++) {
+		free(vals[m]);
+	}
+	for (cpu = 0; cpu < metrics_nr_cpus; cpu++) {
+		free(metrics[cpu].recs);
+	}
+	free(metrics);
+	if (file != NULL) {
+		fclose(file);
+	}
+}
+
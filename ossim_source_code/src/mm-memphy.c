@@ -6,6 +6,7 @@
 
 #include "mm.h"
 #include <stdlib.h>
+#include <string.h>
 
 #include <stdio.h>
 /*
@@ -106,61 +107,189 @@ int MEMPHY_write(struct memphy_struct * mp, int addr, BYTE data)
    return 0;
 }
 
+/*
+ *  MEMPHY_seek_page - position the device on frame [fpn]
+ *  @mp: memphy struct
+ *  @fpn: frame number
+ *
+ *  Returns the address of the frame, or -1 if there is no such frame. A
+ *  sequential device seeks once per page instead of once per byte.
+ */
+static int MEMPHY_seek_page(struct memphy_struct *mp, int fpn)
+{
+   int addr;
+
+   if (mp == NULL || fpn < 0 || fpn >= mp->maxfp)
+     return -1;
+
+   addr = fpn * PAGING_PAGESZ;
+   if (!mp->rdmflg)
+      MEMPHY_mv_csr(mp, addr);
+
+   return addr;
+}
+
+/* The cursor of a sequential device ends right after the page */
+static void MEMPHY_end_page(struct memphy_struct *mp, int addr)
+{
+   if (!mp->rdmflg)
+      mp->cursor = (addr + PAGING_PAGESZ) % mp->maxsz;
+}
+
+/*
+ *  MEMPHY_read_page - read a whole frame of MEMPHY device
+ *  @mp: memphy struct
+ *  @fpn: frame number
+ *  @buf: PAGING_PAGESZ bytes of obtained data
+ */
+int MEMPHY_read_page(struct memphy_struct *mp, int fpn, BYTE *buf)
+{
+   int addr = MEMPHY_seek_page(mp, fpn);
+
+   if (addr < 0 || buf == NULL)
+     return -1;
+
+   memcpy(buf, mp->storage + addr, PAGING_PAGESZ);
+   MEMPHY_end_page(mp, addr);
+
+   return 0;
+}
+
+/*
+ *  MEMPHY_write_page - write a whole frame of MEMPHY device
+ *  @mp: memphy struct
+ *  @fpn: frame number
+ *  @buf: PAGING_PAGESZ bytes of written data
+ */
+int MEMPHY_write_page(struct memphy_struct *mp, int fpn, const BYTE *buf)
+{
+   int addr = MEMPHY_seek_page(mp, fpn);
+
+   if (addr < 0 || buf == NULL)
+     return -1;
+
+   memcpy(mp->storage + addr, buf, PAGING_PAGESZ);
+   MEMPHY_end_page(mp, addr);
+
+   return 0;
+}
+
+/*
+ *  MEMPHY_copy_page - copy a whole frame between MEMPHY devices
+ *  @mpsrc: source memphy
+ *  @srcfpn: source frame number
+ *  @mpdst: destination memphy, may be [mpsrc]
+ *  @dstfpn: destination frame number
+ */
+int MEMPHY_copy_page(struct memphy_struct *mpsrc, int srcfpn,
+                     struct memphy_struct *mpdst, int dstfpn)
+{
+   int addrsrc = MEMPHY_seek_page(mpsrc, srcfpn);
+   int addrdst = MEMPHY_seek_page(mpdst, dstfpn);
+
+   if (addrsrc < 0 || addrdst < 0)
+     return -1;
+
+   /* Frames never overlap, unless it is the very same one */
+   if (mpsrc != mpdst || srcfpn != dstfpn)
+      memcpy(mpdst->storage + addrdst, mpsrc->storage + addrsrc,
+             PAGING_PAGESZ);
+   MEMPHY_end_page(mpsrc, addrsrc);
+   MEMPHY_end_page(mpdst, addrdst);
+
+   return 0;
+}
+
+#define FP_BITS (8 * sizeof(unsigned long))
+
+static int fp_used(struct memphy_struct *mp, int fpn)
+{
+   return (mp->used_fp[fpn / FP_BITS] >> (fpn % FP_BITS)) & 1;
+}
+
 /*
  *  MEMPHY_format-format MEMPHY device
  *  @mp: memphy struct
+ *
+ *  All frames start free, the stack is filled so that they are handed out
+ *  from frame 0 upwards.
  */
 int MEMPHY_format(struct memphy_struct *mp, int pagesz)
 {
     /* This setting come with fixed constant PAGESZ */
     int numfp = mp->maxsz / pagesz;
-    struct framephy_struct *newfst, *fst;
-    int iter = 0;
+    int iter;
+
+    mp->free_fpn = NULL;
+    mp->used_fp = NULL;
+    mp->nr_free = 0;
+    mp->maxfp = 0;
+    pthread_mutex_init(&mp->fp_lock, NULL);
 
     if (numfp <= 0)
       return -1;
 
-    /* Init head of free framephy list */ 
-    fst = malloc(sizeof(struct framephy_struct));
-    fst->fpn = iter;
-    mp->free_fp_list = fst;
-
-    /* We have list with first element, fill in the rest num-1 element member*/
-    for (iter = 1; iter < numfp ; iter++)
-    {
-       newfst =  malloc(sizeof(struct framephy_struct));
-       newfst->fpn = iter;
-       newfst->fp_next = NULL;
-       fst->fp_next = newfst;
-       fst = newfst;
+    mp->free_fpn = malloc(numfp * sizeof(int));
+    mp->used_fp = calloc((numfp + FP_BITS - 1) / FP_BITS, sizeof(unsigned long));
+    if (mp->free_fpn == NULL || mp->used_fp == NULL) {
+       printf("[MEMPHY_FORMAT] Error: Out of memory for %d frames.\n", numfp);
+       free(mp->free_fpn);
+       free(mp->used_fp);
+       mp->free_fpn = NULL;
+       mp->used_fp = NULL;
+       return -1;
     }
 
+    for (iter = 0; iter < numfp; iter++)
+       mp->free_fpn[iter] = numfp - 1 - iter;
+    mp->nr_free = numfp;
+    mp->maxfp = numfp;
+
     return 0;
 }
 
+/*
+ *  MEMPHY_get_freefps - take [nr] free frames at once
+ *  @mp: memphy struct
+ *  @nr: number of frames
+ *  @retfpns: obtained frame numbers
+ *
+ *  Either all [nr] frames are taken or, when fewer are free, none.
+ */
+int MEMPHY_get_freefps(struct memphy_struct *mp, int nr, int *retfpns)
+{
+   int iter;
+
+   if (mp == NULL || retfpns == NULL || nr < 0) {
+        printf("[MEMPHY_GET_FREEFPS] Error: Invalid memory structure or output pointer.\n");
+        return -1;
+    }
+   pthread_mutex_lock(&mp->fp_lock);
+
+   if (mp->nr_free < nr){
+       pthread_mutex_unlock(&mp->fp_lock);
+     return -1;
+   }
+   for (iter = 0; iter < nr; iter++) {
+      int fpn = mp->free_fpn[--mp->nr_free];
+      mp->used_fp[fpn / FP_BITS] |= 1UL << (fpn % FP_BITS);
+      retfpns[iter] = fpn;
+   }
+
+   pthread_mutex_unlock(&mp->fp_lock);
+   return 0;
+}
+
 int MEMPHY_get_freefp(struct memphy_struct *mp, int *retfpn)
 {
    if (mp == NULL || retfpn == NULL) {
         printf("[MEMPHY_GET_FREEFP] Error: Invalid memory structure or output pointer.\n");
         return -1;
     }
-   pthread_mutex_lock(&ram_lock); // Đảm bảo đồng bộ hóa
-
-   struct framephy_struct *fp = mp->free_fp_list;
-
-   if (fp == NULL){
+   if (MEMPHY_get_freefps(mp, 1, retfpn) != 0) {
        printf("[MEMPHY_GET_FREEFP] Error: No free frame available.\n");
-       pthread_mutex_unlock(&ram_lock);
      return -1;
    }
-   *retfpn = fp->fpn;
-   mp->free_fp_list = fp->fp_next;
-
-   /* MEMPHY is iteratively used up until its exhausted
-    * No garbage collector acting then it not been released
-    */
-   free(fp);
-   pthread_mutex_unlock(&ram_lock);
    return 0;
 }
 
@@ -200,14 +329,22 @@ int MEMPHY_dump(struct memphy_struct * mp)
 }
 int MEMPHY_put_freefp(struct memphy_struct *mp, int fpn)
 {
-   struct framephy_struct *fp = mp->free_fp_list;
-   struct framephy_struct *newnode = malloc(sizeof(struct framephy_struct));
+   if (mp == NULL || fpn < 0 || fpn >= mp->maxfp) {
+      printf("[MEMPHY_PUT_FREEFP] Error: Invalid frame %d.\n", fpn);
+      return -1;
+   }
+   pthread_mutex_lock(&mp->fp_lock);
 
-   /* Create new node with value fpn */
-   newnode->fpn = fpn;
-   newnode->fp_next = fp;
-   mp->free_fp_list = newnode;
+   /* A frame freed twice would be handed out twice */
+   if (!fp_used(mp, fpn)) {
+      pthread_mutex_unlock(&mp->fp_lock);
+      printf("[MEMPHY_PUT_FREEFP] Error: Frame %d is already free.\n", fpn);
+      return -1;
+   }
+   mp->used_fp[fpn / FP_BITS] &= ~(1UL << (fpn % FP_BITS));
+   mp->free_fpn[mp->nr_free++] = fpn;
 
+   pthread_mutex_unlock(&mp->fp_lock);
    return 0;
 }
 
@@ -0,0 +1,267 @@
+// #ifdef MM_PAGING
+/*
+ * PAGING based Memory Management
+ * Page replacement policies mm/mm-repl.c
+ *
+ * Every process keeps its resident pages in a ring, oldest first, and a
+ * word per page next to its PTE (pg_meta). The policy is chosen with
+ * --pgrepl, FIFO by default:
+ *  fifo  - evict the oldest page
+ *  clock - pg_getval/pg_setval set the referenced bit of the page; the
+ *          oldest page is evicted unless referenced, then it loses the
+ *          bit and goes to the back (second chance)
+ *  lru   - aging: every time the process made as many accesses as it has
+ *          resident pages, each page's 8-bit age shifts right and takes
+ *          its referenced bit on top. A page referenced since then is
+ *          kept, otherwise the least age is evicted
+ *  lfu   - every access counts, the least used page is evicted
+ * FIFO and clock take amortized O(1) per eviction, lru and lfu scan the
+ * resident pages once.
+ */
+
+#include "mm.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#define PG_REFERENCED BIT(31)
+#define PG_COUNT_MASK (PG_REFERENCED - 1)
+#define PG_AGE_BITS 8
+
+struct pgrepl_class {
+  const char *name;
+  /* [pgn] of [mm] was read or written, optional */
+  void (*access)(struct mm_struct *mm, int pgn);
+  /* Take the page to evict out of the resident ring of [mm] */
+  int (*victim)(struct mm_struct *mm, int *pgn);
+};
+
+/* Statistics, atomic */
+static unsigned long nr_faults = 0;
+static unsigned long nr_evictions = 0;
+
+static int ring_push(struct pg_ring *ring, int pgn)
+{
+  if (ring->size == ring->cap) {
+    int cap = ring->cap ? 2 * ring->cap : 16;
+    int *grown = malloc(cap * sizeof(int));
+    int i;
+
+    if (grown == NULL)
+      return -1;
+    /* Unwrap the ring so that the oldest page is at 0 */
+    for (i = 0; i < ring->size; i++)
+      grown[i] = ring->pgn[(ring->head + i) % ring->cap];
+    free(ring->pgn);
+    ring->pgn = grown;
+    ring->head = 0;
+    ring->cap = cap;
+  }
+  ring->pgn[(ring->head + ring->size) % ring->cap] = pgn;
+  ring->size++;
+
+  return 0;
+}
+
+static int ring_pop(struct pg_ring *ring)
+{
+  int pgn = ring->pgn[ring->head];
+
+  ring->head = (ring->head + 1) % ring->cap;
+  ring->size--;
+
+  return pgn;
+}
+
+static int *ring_at(struct pg_ring *ring, int i)
+{
+  return &ring->pgn[(ring->head + i) % ring->cap];
+}
+
+/* Take the [i]th oldest page out, the oldest one fills its place */
+static int ring_remove(struct pg_ring *ring, int i)
+{
+  int pgn = *ring_at(ring, i);
+
+  *ring_at(ring, i) = ring->pgn[ring->head];
+  ring_pop(ring);
+
+  return pgn;
+}
+
+static int fifo_victim(struct mm_struct *mm, int *pgn)
+{
+  *pgn = ring_pop(&mm->resident);
+
+  return 0;
+}
+
+static void referenced_access(struct mm_struct *mm, int pgn)
+{
+  uint32_t *meta = pg_meta(mm, pgn);
+
+  if (meta)
+    *meta |= PG_REFERENCED;
+}
+
+static int clock_victim(struct mm_struct *mm, int *pgn)
+{
+  struct pg_ring *ring = &mm->resident;
+
+  /* At most one lap: every page passed over loses its bit */
+  for (;;) {
+    int cur = ring_pop(ring);
+    uint32_t *meta = pg_meta(mm, cur);
+
+    if (meta == NULL || !(*meta & PG_REFERENCED)) {
+      *pgn = cur;
+      return 0;
+    }
+    *meta &= ~PG_REFERENCED;
+    ring_push(ring, cur);
+  }
+}
+
+static void lru_access(struct mm_struct *mm, int pgn)
+{
+  referenced_access(mm, pgn);
+  mm->resident.nr_access++;
+}
+
+static int lru_victim(struct mm_struct *mm, int *pgn)
+{
+  struct pg_ring *ring = &mm->resident;
+  int tick = ring->nr_access - ring->aged >= ring->size;
+  uint32_t least = UINT32_MAX;
+  int i, victim = 0;
+
+  if (tick)
+    ring->aged = ring->nr_access;
+  for (i = 0; i < ring->size; i++) {
+    uint32_t *meta = pg_meta(mm, *ring_at(ring, i));
+    uint32_t age;
+
+    if (meta == NULL)
+      continue;
+    if (tick) {
+      age = (*meta & PG_COUNT_MASK) >> 1;
+      if (*meta & PG_REFERENCED)
+        age |= BIT(PG_AGE_BITS - 1);
+      *meta = age;
+    }
+    /* Referenced since the last tick is more recent than any age */
+    age = *meta & PG_REFERENCED ? BIT(PG_AGE_BITS) : *meta & PG_COUNT_MASK;
+    /* Ties go to the oldest page */
+    if (age < least) {
+      least = age;
+      victim = i;
+    }
+  }
+  *pgn = ring_remove(ring, victim);
+
+  return 0;
+}
+
+static void lfu_access(struct mm_struct *mm, int pgn)
+{
+  uint32_t *meta = pg_meta(mm, pgn);
+
+  if (meta && (*meta & PG_COUNT_MASK) != PG_COUNT_MASK)
+    (*meta)++;
+}
+
+static int lfu_victim(struct mm_struct *mm, int *pgn)
+{
+  struct pg_ring *ring = &mm->resident;
+  uint32_t least = UINT32_MAX;
+  int i, victim = 0;
+
+  for (i = 0; i < ring->size; i++) {
+    uint32_t *meta = pg_meta(mm, *ring_at(ring, i));
+    uint32_t count = meta ? *meta & PG_COUNT_MASK : 0;
+
+    if (count < least) {
+      least = count;
+      victim = i;
+    }
+  }
+  *pgn = ring_remove(ring, victim);
+
+  return 0;
+}
+
+static const struct pgrepl_class pgrepl_classes[] = {
+  { .name = "fifo", .victim = fifo_victim },
+  { .name = "clock", .access = referenced_access, .victim = clock_victim },
+  { .name = "lru", .access = lru_access, .victim = lru_victim },
+  { .name = "lfu", .access = lfu_access, .victim = lfu_victim },
+};
+
+static const struct pgrepl_class *pgrepl = &pgrepl_classes[0];
+
+int set_pgrepl(const char *name)
+{
+  int i;
+
+  for (i = 0; i < sizeof(pgrepl_classes) / sizeof(pgrepl_classes[0]); i++) {
+    if (!strcmp(pgrepl_classes[i].name, name)) {
+      pgrepl = &pgrepl_classes[i];
+      return 0;
+    }
+  }
+
+  return -1;
+}
+
+/*
+ * pg_admit - [pgn] of [mm] was just mapped, it may be evicted from now on
+ */
+int pg_admit(struct mm_struct *mm, int pgn)
+{
+  uint32_t *meta = pg_meta(mm, pgn);
+
+  if (meta)
+    *meta = 0;
+
+  return ring_push(&mm->resident, pgn);
+}
+
+void pg_access(struct mm_struct *mm, int pgn)
+{
+  if (pgrepl->access)
+    pgrepl->access(mm, pgn);
+}
+
+void pgrepl_count_fault(void)
+{
+  __atomic_add_fetch(&nr_faults, 1, __ATOMIC_RELAXED);
+}
+
+/*find_victim_page - find victim page
+ *@mm: memory management struct
+ *@retpgn: return page number
+ *
+ */
+int find_victim_page(struct mm_struct *mm, int *retpgn)
+{
+  if (mm->resident.size == 0) {
+    printf("[FIND_VICTIM_PAGE] Error: No resident page to select as victim.\n");
+    return -1;
+  }
+  if (pgrepl->victim(mm, retpgn) != 0)
+    return -1;
+  __atomic_add_fetch(&nr_evictions, 1, __ATOMIC_RELAXED);
+
+  return 0;
+}
+
+void finish_pgrepl(void)
+{
+  /* Nothing ever faulted, e.g. no process touched paged memory */
+  if (nr_faults == 0)
+    return;
+  printf("Page replacement (%s)\n", pgrepl->name);
+  printf("\tfaults: %lu, evictions: %lu\n", nr_faults, nr_evictions);
+}
+
+// #endif
@@ -6,9 +6,13 @@
 
 #include "string.h"
 #include "mm.h"
+#include "tlb.h"
 #include <stdlib.h>
 #include <stdio.h>
 
+pthread_mutex_t ram_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t swap_lock = PTHREAD_MUTEX_INITIALIZER;
+
 /*enlist_vm_freerg_list - add new rg to freerg_list
  *@mm: memory region
  *@rg_elmt: new region
@@ -16,18 +20,14 @@
  */
 int enlist_vm_freerg_list(struct mm_struct *mm, struct vm_rg_struct rg_elmt)
 {
-    struct vm_rg_struct *rg_node = mm->mmap->vm_freerg_list;
+    struct vm_area_struct *vma = get_vma_by_num(mm, rg_elmt.vmaid);
 
-  if (rg_elmt.rg_start >= rg_elmt.rg_end)
+  if (vma == NULL || rg_elmt.rg_start >= rg_elmt.rg_end)
     return -1;
 
-  if (rg_node != NULL)
-    rg_elmt.rg_next = rg_node;
-
-  /* Enlist the new region */
-  mm->mmap->vm_freerg_list = &rg_elmt;
-
-  return 0;
+  /* Enlist the new region in the free list of its area */
+  return enlist_vm_rg_node(&vma->vm_freerg_list,
+                           init_vm_rg(rg_elmt.rg_start, rg_elmt.rg_end, rg_elmt.vmaid));
 }
 
 /*get_vma_by_num - get vm area by numID
@@ -84,35 +84,25 @@ int __alloc(struct pcb_t *caller, int vmaid, int rgid, int size, int *alloc_addr
     }
 
     struct vm_rg_struct rgnode;
+    int inc_limit;
     rgnode.vmaid = vmaid;
-    int remaining_size = size;
-
-        // Đảm bảo kích thước mở rộng tối thiểu là bội của PAGING_SBRK_INIT_SZ
-    int min_expand_size = PAGING_SBRK_INIT_SZ;
-    int aligned_size = (remaining_size + min_expand_size - 1) / min_expand_size * min_expand_size;
-
-    while (remaining_size > 0) {
-        if (get_free_vmrg_area(caller, vmaid, remaining_size, &rgnode) == 0) {
-            caller->mm->symrgtbl[rgid].rg_start = rgnode.rg_start;
-            caller->mm->symrgtbl[rgid].rg_end = rgnode.rg_end;
-            caller->mm->symrgtbl[rgid].vmaid = rgnode.vmaid;
-            *alloc_addr = rgnode.rg_start;
-            return 0;
-        }
-
-        int expand_size = (remaining_size > aligned_size) ? aligned_size : min_expand_size;
-        if (vmaid == 1) expand_size = -expand_size;
 
-        if (inc_vma_limit(caller, vmaid, expand_size, NULL) != 0) {
+    /* Grow the area by the page aligned size when no free region fits */
+    if (get_free_vmrg_area(caller, vmaid, size, &rgnode) != 0) {
+        if (inc_vma_limit(caller, vmaid, size, &inc_limit) != 0) {
             printf("Failed to expand segment %d\n", vmaid);
             return -1;
         }
-
-        printf("Segment %d expanded successfully by %d bytes\n", vmaid, expand_size);
-        remaining_size -= abs(expand_size);
+        printf("Segment %d expanded successfully by %d bytes\n", vmaid, inc_limit);
+        if (get_free_vmrg_area(caller, vmaid, size, &rgnode) != 0)
+            return -1;
     }
 
-    return -1;
+    caller->mm->symrgtbl[rgid].rg_start = rgnode.rg_start;
+    caller->mm->symrgtbl[rgid].rg_end = rgnode.rg_end;
+    caller->mm->symrgtbl[rgid].vmaid = vmaid;
+    *alloc_addr = rgnode.rg_start;
+    return 0;
 }
 
 /*__free - remove a region memory
@@ -187,50 +177,107 @@ int pgfree_data(struct pcb_t *proc, uint32_t reg_index)
     return __free(proc, reg_index);
 }
 
-/*pg_getpage - get the page in ram
- *@mm: memory region
- *@pagenum: PGN
- *@framenum: return FPN
+/*swap_out_victim - give up the RAM frame of a resident page to swap
  *@caller: caller
+ *@retfpn: return the freed FPN
  *
  */
-int pg_getpage(struct mm_struct *mm, int pgn, int *fpn, struct pcb_t *caller)
+int swap_out_victim(struct pcb_t *caller, int *retfpn)
 {
-    uint32_t pte = mm->pgd[pgn];
-
-    if (!PAGING_PTE_PAGE_PRESENT(pte)) {
-    //printf("[PG_GETPAGE] Page %d is not in memory, performing swap...\n", pgn);
+    struct mm_struct *mm = caller->mm;
+    int vicpgn, vicfpn, swpfpn;
 
-    int vicpgn, swpfpn;
     if (find_victim_page(mm, &vicpgn) != 0) {
-        printf("[PG_GETPAGE] Error: Cannot find victim page\n");
+        printf("[SWAP_OUT_VICTIM] Error: Cannot find victim page\n");
+        return -1;
+    }
+    uint32_t *vicpte = pte_alloc(mm, vicpgn);
+    if (vicpte == NULL) {
+        printf("[SWAP_OUT_VICTIM] Error: Cannot allocate page table for page %d\n", vicpgn);
         return -1;
     }
+    vicfpn = PAGING_PTE_FPN(*vicpte);
+
     pthread_mutex_lock(&swap_lock);
     if (MEMPHY_get_freefp(caller->active_mswp, &swpfpn) != 0) {
-        printf("[PG_GETPAGE] Error: No free frame in swap\n");
+        printf("[SWAP_OUT_VICTIM] Error: No free frame in swap\n");
         pthread_mutex_unlock(&swap_lock);
+        /* The victim stays resident */
+        pg_admit(mm, vicpgn);
         return -1;
     }
     pthread_mutex_unlock(&swap_lock);
-    //printf("[PG_GETPAGE] Swapping out victim page %d to frame %d in swap\n", vicpgn, swpfpn);
-    __swap_cp_page(caller->mram, vicpgn, caller->active_mswp, swpfpn);
+    __swap_cp_page(caller->mram, vicfpn, caller->active_mswp, swpfpn);
 
-    // Cập nhật trạng thái của victim page
-    pte_set_swap(&mm->pgd[vicpgn], PAGING_PTE_SWAPPED_MASK, swpfpn);
+    /* Its frame number is overwritten by the swap offset */
+    pte_set_swap(vicpte, 0, swpfpn);
+#ifdef MM_TLB
+    tlb_shootdown(caller->pid, vicpgn);
+#endif
+    *retfpn = vicfpn;
 
-    //printf("[PG_GETPAGE] Victim page %d swapped out successfully.\n", vicpgn);
+    return 0;
+}
+
+/*pg_getpage - get the page in ram
+ *@mm: memory region
+ *@pagenum: PGN
+ *@framenum: return FPN
+ *@caller: caller
+ *
+ */
+int pg_getpage(struct mm_struct *mm, int pgn, int *fpn, struct pcb_t *caller)
+{
+    uint32_t pte;
+
+#ifdef MM_TLB
+    /* Translated lately on this CPU, skip the page table walk */
+    if (tlb_lookup(caller->cur_cpu, caller->pid, pgn, &pte) == 0) {
+        *fpn = PAGING_PTE_FPN(pte);
+        return 0;
+    }
+#endif
+    pte = pte_get(mm, pgn);
 
-     pte_set_fpn(&mm->pgd[pgn], vicpgn);
-        PAGING_PTE_SET_PRESENT(mm->pgd[pgn]);
+    if (!PAGING_PTE_PAGE_PRESENT(pte)) {
+        printf("[PG_GETPAGE] Error: Page %d is not mapped\n", pgn);
+        return -1;
+    }
 
-        // Thêm trang mục tiêu vào danh sách FIFO
-        if (enlist_pgn_node(&caller->mm->fifo_pgn, pgn) != 0) {
-            return -1; // Thêm vào danh sách thất bại
+    /* Swapped out, bring it back in a free frame or in the frame of a
+     * victim page, which takes its place in swap */
+    if (pte & PAGING_PTE_SWAPPED_MASK) {
+        int tgtfpn, swpfpn = PAGING_PTE_SWP(pte);
+
+        pgrepl_count_fault();
+        /* Quietly, running out of free frames is expected here */
+        pthread_mutex_lock(&ram_lock);
+        int nofree = MEMPHY_get_freefps(caller->mram, 1, &tgtfpn);
+        pthread_mutex_unlock(&ram_lock);
+        if (nofree && swap_out_victim(caller, &tgtfpn) != 0) {
+            return -1;
         }
-}
+        __swap_cp_page(caller->active_mswp, swpfpn, caller->mram, tgtfpn);
+        pthread_mutex_lock(&swap_lock);
+        MEMPHY_put_freefp(caller->active_mswp, swpfpn);
+        pthread_mutex_unlock(&swap_lock);
+
+        uint32_t *pgpte = pte_alloc(mm, pgn);
+        if (pgpte == NULL) {
+            printf("[PG_GETPAGE] Error: Cannot allocate page table for page %d\n", pgn);
+            return -1;
+        }
+        pte_set_fpn(pgpte, tgtfpn);
+        if (pg_admit(mm, pgn) != 0) {
+            return -1;
+        }
+    }
 
-    *fpn = PAGING_PTE_FPN(mm->pgd[pgn]);
+    pte = pte_get(mm, pgn);
+    *fpn = PAGING_PTE_FPN(pte);
+#ifdef MM_TLB
+    tlb_fill(caller->cur_cpu, caller->pid, pgn, pte);
+#endif
     //printf("[PG_GETPAGE] Page %d is in memory, frame number %d\n", pgn, *fpn);
 
     return 0;
@@ -254,6 +301,7 @@ int pg_getval(struct mm_struct *mm, int addr, BYTE *data, struct pcb_t *caller)
         return -1;
     }
     printf("[PG_SETVAL] SUCCESS to get page for addr=%d (page=%d).\n", addr, pgn);
+    pg_access(mm, pgn);
     int phyaddr = (fpn << PAGING_ADDR_FPN_LOBIT) + off;
     pthread_mutex_lock(&ram_lock);
     if (MEMPHY_read(caller->mram, phyaddr, data) != 0) {
@@ -283,6 +331,7 @@ int pg_setval(struct mm_struct *mm, int addr, BYTE value, struct pcb_t *caller)
         return -1;
     }
     printf("[PG_SETVAL] SUCESS GET PAGE for addr =%d (page =%d).\n", addr, pgn);
+    pg_access(mm, pgn);
 
     int phyaddr = (fpn << PAGING_ADDR_FPN_LOBIT) + off;
     pthread_mutex_lock(&ram_lock);
@@ -390,25 +439,40 @@ int pgwrite(
  */
 int free_pcb_memph(struct pcb_t *caller)
 {
-    int pagenum, fpn;
+    int pgdit, pagenum, fpn;
   uint32_t pte;
 
-  for(pagenum = 0; pagenum < PAGING_MAX_PGN; pagenum++)
+  if (caller->mm->pgd == NULL)
+    return 0;
+
+  /* Only the leaf tables that were ever populated can map a frame */
+  for(pgdit = 0; pgdit < PAGING_PGD_SZ; pgdit++)
   {
-    pte= caller->mm->pgd[pagenum];
-    if (!PAGING_PTE_PAGE_PRESENT(pte))
+    uint32_t *ptbl = caller->mm->pgd[pgdit];
+    if (ptbl == NULL)
+      continue;
+    for(pagenum = 0; pagenum < PAGING_PTBL_SZ; pagenum++)
     {
-        fpn = PAGING_PTE_FPN(pte);
-        pthread_mutex_lock(&ram_lock);
-        MEMPHY_put_freefp(caller->mram, fpn);
-        pthread_mutex_unlock(&ram_lock);
-    } else {
-        fpn = PAGING_PTE_SWP(pte);
-        pthread_mutex_lock(&swap_lock);
-        MEMPHY_put_freefp(caller->active_mswp, fpn);    
-        pthread_mutex_unlock(&swap_lock);
+      pte = ptbl[pagenum];
+      if (!PAGING_PTE_PAGE_PRESENT(pte))
+        continue;
+      if (!(pte & PAGING_PTE_SWAPPED_MASK))
+      {
+          fpn = PAGING_PTE_FPN(pte);
+          pthread_mutex_lock(&ram_lock);
+          MEMPHY_put_freefp(caller->mram, fpn);
+          pthread_mutex_unlock(&ram_lock);
+      } else {
+          fpn = PAGING_PTE_SWP(pte);
+          pthread_mutex_lock(&swap_lock);
+          MEMPHY_put_freefp(caller->active_mswp, fpn);
+          pthread_mutex_unlock(&swap_lock);
+      }
     }
   }
+#ifdef MM_TLB
+  tlb_flush_asid(caller->pid);
+#endif
 
   return 0;
 }
@@ -497,53 +561,26 @@ int inc_vma_limit(struct pcb_t *caller, int vmaid, int inc_sz, int *inc_limit_re
     }
 
 
+    int old_end = cur_vma->vm_end;
+    struct vm_rg_struct newrg;
+
     if(vmaid == 1) {
       cur_vma->vm_end -= inc_amt;
     }else if(vmaid == 0) {
       cur_vma->vm_end += inc_amt;
     }
-    *inc_limit_ret = inc_amt;
-
-    printf("[INC_VMA_LIMIT] VMA %d expanded to: start=%d, end=%d\n", vmaid, cur_vma->vm_start, cur_vma->vm_end);
-    return 0;
-}
-
-/*find_victim_page - find victim page
- *@caller: caller
- *@pgn: return page number
- *
- */
-int find_victim_page(struct mm_struct *mm, int *retpgn)
-{
-    struct pgn_t *pg = mm->fifo_pgn;
-
-    /* TODO: Implement the theorical mechanism to find the victim page */
-
-    if (!pg) {
-        printf("[FIND_VICTIM_PAGE] Error: No pages in FIFO list to select as victim.\n");
-        return -1;
-    }
-        
-
-    while (pg->pg_next && pg->pg_next->pg_next)
-    {
-        pg = pg->pg_next;
-    }
-    // th1 second to last
-    if (pg->pg_next)
-    {
-        *retpgn = pg->pg_next->pgn;
-        free(pg->pg_next);
-        pg->pg_next = NULL;
-    }
-    // th2 only one
-    else
-    {
-        *retpgn = pg->pgn;
-        free(pg);
-        mm->fifo_pgn = NULL;
+    /* Back the new pages with frames, then offer them for allocation */
+    int mapstart = vmaid == 1 ? cur_vma->vm_end : old_end;
+    if (vm_map_ram(caller, mapstart, mapstart + inc_amt, mapstart, incnumpage, &newrg) < 0) {
+      printf("[INC_VMA_LIMIT] Error: Out of memory while expanding VMA %d\n", vmaid);
+      cur_vma->vm_end = old_end;
+      return -1;
     }
+    enlist_vm_rg_node(&cur_vma->vm_freerg_list, init_vm_rg(mapstart, mapstart + inc_amt, vmaid));
+    if (inc_limit_ret != NULL)
+      *inc_limit_ret = inc_amt;
 
+    printf("[INC_VMA_LIMIT] VMA %d expanded to: start=%d, end=%d\n", vmaid, cur_vma->vm_start, cur_vma->vm_end);
     return 0;
 }
 
@@ -599,6 +636,7 @@ int get_free_vmrg_area(struct pcb_t *caller, int vmaid, int size, struct vm_rg_s
                     rgit->rg_next = NULL;
                 }
             }
+            break;
         }
         else
         {
@@ -79,6 +79,83 @@ int pte_set_fpn(uint32_t *pte, int fpn)
   return 0;
 }
 
+/*
+ * pte_get - Get the PTE of a page, 0 if nothing was ever mapped near it
+ * @mm    : memory management struct
+ * @pgn   : page number
+ */
+uint32_t pte_get(struct mm_struct *mm, int pgn)
+{
+  uint32_t *ptbl;
+
+  if (mm->pgd == NULL || pgn < 0 || pgn >= PAGING_MAX_PGN)
+    return 0;
+  ptbl = mm->pgd[PAGING_PGD_IDX(pgn)];
+
+  return ptbl ? ptbl[PAGING_PTBL_IDX(pgn)] : 0;
+}
+
+/*
+ * pte_alloc - Get the PTE of a page to update it, the directory and the
+ *             leaf table holding it are allocated on first use
+ * @mm    : memory management struct
+ * @pgn   : page number
+ */
+uint32_t *pte_alloc(struct mm_struct *mm, int pgn)
+{
+  uint32_t **ptbl;
+
+  if (pgn < 0 || pgn >= PAGING_MAX_PGN)
+    return NULL;
+  if (mm->pgd == NULL) {
+    mm->pgd = calloc(PAGING_PGD_SZ, sizeof(uint32_t *));
+    if (mm->pgd == NULL)
+      return NULL;
+  }
+  ptbl = &mm->pgd[PAGING_PGD_IDX(pgn)];
+  if (*ptbl == NULL) {
+    *ptbl = calloc(2 * PAGING_PTBL_SZ, sizeof(uint32_t));
+    if (*ptbl == NULL)
+      return NULL;
+  }
+
+  return &(*ptbl)[PAGING_PTBL_IDX(pgn)];
+}
+
+/*
+ * pg_meta - Get the word the page replacement policy keeps for a page,
+ *           it sits in the leaf table PAGING_PTBL_SZ words after the PTE
+ * @mm    : memory management struct
+ * @pgn   : page number
+ */
+uint32_t *pg_meta(struct mm_struct *mm, int pgn)
+{
+  uint32_t *pte = pte_alloc(mm, pgn);
+
+  return pte ? pte + PAGING_PTBL_SZ : NULL;
+}
+
+/*
+ * free_pgtbl - Release the page table and the resident set, not the
+ *              frames they map
+ * @mm    : memory management struct
+ */
+void free_pgtbl(struct mm_struct *mm)
+{
+  int i;
+
+  if (mm->pgd == NULL)
+    return;
+  for (i = 0; i < PAGING_PGD_SZ; i++)
+    free(mm->pgd[i]);
+  free(mm->pgd);
+  mm->pgd = NULL;
+  free(mm->resident.pgn);
+  mm->resident.pgn = NULL;
+  mm->resident.head = mm->resident.size = mm->resident.cap = 0;
+  mm->resident.nr_access = mm->resident.aged = 0;
+}
+
 /*
  * vmap_page_range - map a range of page at aligned address
  */
@@ -103,13 +180,17 @@ int vmap_page_range(struct pcb_t *caller,           // process call
     // Ánh xạ từng trang ảo vào frame vật lý
   for (int pgit = 0; pgit < pgnum; pgit++) {
     int pgn = pgn_start + pgit;            // Trang hiện tại
-    uint32_t *pte = &caller->mm->pgd[pgn]; // PTE của trang
+    uint32_t *pte = pte_alloc(caller->mm, pgn); // PTE của trang
 
     // Kiểm tra xem frame có đủ để ánh xạ không
     if (cur_frame == NULL) {
         //printf("[VMAP_PAGE_RANGE] Error: Not enough frames for page %d.\n", pgn);
         return -1; // Trả lỗi nếu không đủ frame
     }
+    if (pte == NULL) {
+        printf("[VMAP_PAGE_RANGE] Error: Failed to allocate page table for page %d.\n", pgn);
+        return -1;
+    }
 
     // Kiểm tra trang đã được ánh xạ trước đó chưa
     if (PAGING_PTE_PAGE_PRESENT(*pte)) {
@@ -123,7 +204,10 @@ int vmap_page_range(struct pcb_t *caller,           // process call
     //printf("[VMAP_PAGE_RANGE] Page %d mapped to frame %d.\n", pgn, cur_frame->fpn);
 
     // Thêm trang vào danh sách FIFO để theo dõi
-    enlist_pgn_node(&caller->mm->fifo_pgn, pgn);
+    if (pg_admit(caller->mm, pgn) != 0) {
+        printf("[VMAP_PAGE_RANGE] Error: Failed to track page %d for replacement.\n", pgn);
+        return -1;
+    }
 
     // Chuyển sang frame tiếp theo
     cur_frame = cur_frame->fp_next;
@@ -141,48 +225,56 @@ int vmap_page_range(struct pcb_t *caller,           // process call
 
 int alloc_pages_range(struct pcb_t *caller, int req_pgnum, struct framephy_struct **frm_lst)
 {
-  for (int pgit = 0; pgit < req_pgnum; pgit++) {
-    uint32_t *pte = &caller->mm->pgd[pgit];
+  int *fpns;
 
-    // Kiểm tra nếu trang đã được ánh xạ
-    if (PAGING_PTE_PAGE_PRESENT(*pte)) {
-        //printf("[ALLOC_PAGES_RANGE] Page %d already mapped to frame %d.\n", pgit, PAGING_PTE_FPN(*pte));
-        continue;
+  // Lấy tất cả khung trống từ RAM một lần
+  fpns = malloc(req_pgnum * sizeof(int));
+  if (fpns == NULL) {
+    printf("[ALLOC_PAGES_RANGE] Error: Failed to allocate memory for %d frame numbers.\n", req_pgnum);
+    return -1;
+  }
+  if (MEMPHY_get_freefps(caller->mram, req_pgnum, fpns) != 0) {
+    /* Short of free frames, the missing ones are taken from resident
+     * pages of the caller, which go to swap. Single frames are taken
+     * with MEMPHY_get_freefps, which fails without a message */
+    int fit;
+    /* When not even all of them would do, none is sent to swap */
+    if (caller->mram->nr_free + caller->mm->resident.size < req_pgnum) {
+      free(fpns);
+      return -3000;
     }
-
-    int fpn;
-    // Lấy khung trống từ RAM
-    pthread_mutex_lock(&ram_lock);
-    if (MEMPHY_get_freefp(caller->mram, &fpn) != 0) {
-        pthread_mutex_unlock(&ram_lock);
-
-        //printf("[ALLOC_PAGES_RANGE] Error: Out of free frames.\n");
-        return -1;
+    for (fit = 0; fit < req_pgnum; fit++) {
+      pthread_mutex_lock(&ram_lock);
+      int nofree = MEMPHY_get_freefps(caller->mram, 1, &fpns[fit]);
+      pthread_mutex_unlock(&ram_lock);
+      if (nofree && swap_out_victim(caller, &fpns[fit]) != 0)
+        break;
     }
-    pthread_mutex_unlock(&ram_lock);
+    if (fit < req_pgnum) {
+      //printf("[ALLOC_PAGES_RANGE] Error: Out of free frames.\n");
+      pthread_mutex_lock(&ram_lock);
+      while (fit-- > 0)
+        MEMPHY_put_freefp(caller->mram, fpns[fit]);
+      pthread_mutex_unlock(&ram_lock);
+      free(fpns);
+      return -3000;
+    }
+  }
 
-    // Cập nhật danh sách khung trang
+  /* vmap_page_range maps the frames of the list, in order */
+  for (int fit = req_pgnum - 1; fit >= 0; fit--) {
     struct framephy_struct *node = malloc(sizeof(struct framephy_struct));
     if (node == NULL) {
         printf("[ALLOC_PAGES_RANGE] Error: Failed to allocate memory for framephy_struct.\n");
+        free(fpns);
         return -1;
     }
-    node->fpn = fpn;
+    node->fpn = fpns[fit];
     node->fp_next = *frm_lst;
     *frm_lst = node;
-
-    // Cập nhật PTE
-    pte_set_fpn(pte, fpn);
-    if (!PAGING_PTE_PAGE_PRESENT(*pte)) {
-        printf("[ALLOC_PAGES_RANGE] Error: Failed to set frame number in PTE for page %d.\n", pgit);
-        // Thêm trang vào danh sách FIFO
-          //enlist_pgn_node(&caller->mm->fifo_pgn, pgit);
-        return -1;
-    }
-    enlist_pgn_node(&caller->mm->fifo_pgn, pgit);
-    //printf("[ALLOC_PAGES_RANGE] Page %d mapped to frame %d.\n", pgit, fpn);
   }
 
+  free(fpns);
   return 0;
 }
 
@@ -223,9 +315,15 @@ int vm_map_ram(struct pcb_t *caller, int astart, int aend, int mapstart, int inc
 
   /* it leaves the case of memory is enough but half in ram, half in swap
    * do the swaping all to swapper to get the all in ram */
-  vmap_page_range(caller, mapstart, incpgnum, frm_lst, ret_rg);
+  ret_alloc = vmap_page_range(caller, mapstart, incpgnum, frm_lst, ret_rg);
 
-  return 0;
+  while (frm_lst != NULL) {
+    struct framephy_struct *fp = frm_lst;
+    frm_lst = fp->fp_next;
+    free(fp);
+  }
+
+  return ret_alloc;
 }
 
 /* Swap copy content page from source frame to destination frame
@@ -241,16 +339,9 @@ int __swap_cp_page(struct memphy_struct *mpsrc, int srcfpn,
       printf("[SWAP_CP_PAGE] Error: Invalid frame numbers or memory structures.\n");
       return -1;
   }
-  int cellidx;
-  int addrsrc, addrdst;
-  for (cellidx = 0; cellidx < PAGING_PAGESZ; cellidx++)
-  {
-    addrsrc = srcfpn * PAGING_PAGESZ + cellidx;
-    addrdst = dstfpn * PAGING_PAGESZ + cellidx;
-
-    BYTE data;
-    MEMPHY_read(mpsrc, addrsrc, &data);
-    MEMPHY_write(mpdst, addrdst, data);
+  if (MEMPHY_copy_page(mpsrc, srcfpn, mpdst, dstfpn) != 0) {
+      printf("[SWAP_CP_PAGE] Error: Cannot copy frame %d to frame %d.\n", srcfpn, dstfpn);
+      return -1;
   }
 
   return 0;
@@ -276,24 +367,18 @@ int init_mm(struct mm_struct *mm, struct pcb_t *caller)
     free(vma0);
     return -1;
   }
-  // allocation page with max size page
-  mm->pgd = malloc(PAGING_MAX_PGN * sizeof(uint32_t));
-  if (!mm->pgd) {
-      perror("Allocation failed for page directory");
-      free(vma0);
-      free(vma1);
-      return -1;
-  }
-  for (int i = 0; i < PAGING_MAX_PGN; i++) {
-      mm->pgd[i] = 0;
-  }
+  // page tables are allocated on the first mapping
+  mm->pgd = NULL;
+  mm->resident.pgn = NULL;
+  mm->resident.head = mm->resident.size = mm->resident.cap = 0;
+  mm->resident.nr_access = mm->resident.aged = 0;
   /* By default the owner comes with at least one vma for DATA */
   vma0->vm_id = 0;
   vma0->vm_start = 0;
   vma0->vm_end = vma0->vm_start;
   //vma0->sbrk = vma0->vm_start;
   vma0->sbrk = vma0->vm_start;
-  vma1->vm_freerg_list = NULL;
+  vma0->vm_freerg_list = NULL;
   
   struct vm_rg_struct *first_rg = init_vm_rg(vma0->vm_start, vma0->vm_end, 0);
   enlist_vm_rg_node(&vma0->vm_freerg_list, first_rg);
@@ -305,7 +390,7 @@ int init_mm(struct mm_struct *mm, struct pcb_t *caller)
   vma1->sbrk = vma1->vm_start;
   vma1->vm_freerg_list = NULL;
 
-  struct vm_rg_struct *heap_rg = init_vm_rg(vma1->vm_start, vma1->vm_end, 0);
+  struct vm_rg_struct *heap_rg = init_vm_rg(vma1->vm_start, vma1->vm_end, 1);
   enlist_vm_rg_node(&vma1->vm_freerg_list, heap_rg);
 
   vma0->vm_next = vma1;
@@ -452,7 +537,7 @@ int print_pgtbl(struct pcb_t *caller, uint32_t start, uint32_t end)
 
   for (pgit = pgn_start; pgit < pgn_end; pgit++)
   {
-    printf("%08ld: %08x\n", pgit * sizeof(uint32_t), caller->mm->pgd[pgit]);
+    printf("%08ld: %08x\n", pgit * sizeof(uint32_t), pte_get(caller->mm, pgit));
   }
 
   return 0;
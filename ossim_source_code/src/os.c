@@ -4,15 +4,20 @@
 #include "sched.h"
 #include "loader.h"
 #include "mm.h"
+#include "metrics.h"
+#include "tlb.h"
 
+#include <getopt.h>
 #include <pthread.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <unistd.h>
 
 static int time_slot;
 static int num_cpus;
 static int done = 0;
+static int nr_workers = 0;	// Host threads stepping the CPUs, see --workers
 
 #ifdef MM_PAGING
 static int memramsz;
@@ -37,114 +42,504 @@ static struct ld_args{
 #ifdef MLQ_SCHED
 	unsigned long * prio;
 #endif
+	unsigned long * deadline;	// Relative, 0 if not real-time
+	unsigned long * period;
+	int * group;	// Fair-share group, see sched_add_group()
 } ld_processes;
 int num_processes;
 
 struct cpu_args {
 	struct timer_id_t * timer_id;
 	int id;
+	/* State of the CPU between two time slots */
+	int time_left;
+	int refill;	// Slots left refilling the cache for [proc]
+	struct pcb_t * proc;
+	int parked;	// Skipped by the event engine or its worker, atomic
 };
 
+static struct cpu_args * cpu_list;
+static int cpu_can_park(void);
+static void wake_parked_cpus(int dev);
 
-static void * cpu_routine(void * args) {
-	struct timer_id_t * timer_id = ((struct cpu_args*)args)->timer_id;
-	int id = ((struct cpu_args*)args)->id;
-	/* Check for new process in ready queue */
-	int time_left = 0;
-	struct pcb_t * proc = NULL;
-	while (1) {
-		/* Check the status of current process */
-		if (proc == NULL) {
-			/* No process is running, the we load new process from
-		 	* ready queue */
-			proc = get_proc();
-			if (proc == NULL) {
-                           next_slot(timer_id);
-                           continue; /* First load failed. skip dummy load */
-                        }
-		}else if (proc->pc == proc->code->size) {
-			/* The porcess has finish it job */
-			printf("\tCPU %d: Processed %2d has finished\n",
-				id ,proc->pid);
-			free(proc);
-			proc = get_proc();
-			time_left = 0;
-		}else if (time_left == 0) {
-			/* The process has done its job in current time slot */
-			printf("\tCPU %d: Put process %2d to run queue\n",
-				id, proc->pid);
-			put_proc(proc);
-			proc = get_proc();
+static void free_proc(struct pcb_t * proc) {
+#ifdef MM_PAGING
+	/* Give its frames back (and drop its TLB entries) while the page
+	 * table still maps them */
+	free_pcb_memph(proc);
+	free_pgtbl(proc->mm);
+#endif
+	free(proc);
+}
+
+/* Returned by a device step when the device has nothing left to do */
+#define SLOT_STOP 0
+
+/* Run CPU [cpu] for one time slot. Return the slot the CPU must be stepped
+ * again at, SLOT_NEVER if it is idle or SLOT_STOP if it stopped */
+static uint64_t cpu_step(struct cpu_args * cpu) {
+	int id = cpu->id;
+	struct pcb_t * proc = cpu->proc;
+	/* Check the status of current process */
+	if (proc == NULL) {
+		/* No process is running, the we load new process from
+		 * ready queue */
+		proc = get_proc(id);
+	}else if (proc->pc == proc->code->size) {
+		/* The porcess has finish it job */
+		printf("\tCPU %d: Processed %2d has finished\n",
+			id ,proc->pid);
+		proc->finish = current_time();
+		record_metrics(id, proc);
+		sched_exit(id, proc);
+		free_proc(proc);
+		proc = get_proc(id);
+		cpu->time_left = 0;
+	}else if (cpu->time_left == 0) {
+		/* The process has done its job in current time slot */
+		printf("\tCPU %d: Put process %2d to run queue\n",
+			id, proc->pid);
+		put_proc(id, proc);
+		proc = get_proc(id);
+		wake_parked_cpus(id + 1);
+	}else if (sched_need_resched(id) || edf_preempts(proc)) {
+		/* A more urgent process has arrived for this CPU */
+		printf("\tCPU %d: Preempted process %2d\n",
+			id, proc->pid);
+		put_proc(id, proc);
+		proc = get_proc(id);
+		wake_parked_cpus(id + 1);
+		cpu->time_left = 0;
+		cpu->refill = 0;
+	}
+	cpu->proc = proc;
+
+	/* Recheck process status after loading new process */
+	if (proc == NULL && done) {
+		/* No process to run, exit */
+		printf("\tCPU %d stopped\n", id);
+		return SLOT_STOP;
+	}else if (proc == NULL) {
+		/* There may be new processes to run in
+		 * next time slots, just skip current slot */
+		return SLOT_NEVER;
+	}else if (cpu->time_left == 0) {
+		printf("\tCPU %d: Dispatched process %2d\n",
+			id, proc->pid);
+		if (proc->first_run == SLOT_NEVER) {
+			proc->first_run = current_time();
+		}else if (!sched_cache_hot(proc, id)) {
+			cpu->refill = CACHE_REFILL_PENALTY;
 		}
-		
-		/* Recheck process status after loading new process */
-		if (proc == NULL && done) {
-			/* No process to run, exit */
-			printf("\tCPU %d stopped\n", id);
-			break;
-		}else if (proc == NULL) {
-			/* There may be new processes to run in
-			 * next time slots, just skip current slot */
-			next_slot(timer_id);
-			continue;
-		}else if (time_left == 0) {
-			printf("\tCPU %d: Dispatched process %2d\n",
-				id, proc->pid);
-			time_left = time_slot;
+		record_dispatch(id, proc, cpu->refill);
+		cpu->time_left = sched_quantum(id, proc);
+		if (cpu->time_left == 0) {
+			cpu->time_left = time_slot;
 		}
-		
-		/* Run current process */
+	}
+
+	/* Run current process, once its cache is warm again */
+	int refill = cpu->refill > 0;
+	if (refill) {
+		cpu->refill--;
+	}else{
+		proc->cur_cpu = id;
 		run(proc);
-		time_left--;
-		next_slot(timer_id);
+		cpu->time_left--;
 	}
-	detach_event(timer_id);
+	proc->run_slots++;
+	proc->last_cpu = id;
+	proc->last_run = current_time();
+	record_busy_slot(id);
+	sched_tick(id, proc, refill);
+	return current_time() + 1;
+}
+
+static void * cpu_routine(void * args) {
+	struct cpu_args * cpu = (struct cpu_args*)args;
+	uint64_t wake;
+	/* Check for new process in ready queue */
+	cpu->time_left = 0;
+	cpu->refill = 0;
+	cpu->proc = NULL;
+	while ((wake = cpu_step(cpu)) != SLOT_STOP) {
+		if (wake == SLOT_NEVER) {
+			park_event(cpu->timer_id, cpu_can_park);
+		}else{
+			next_idle_slot(cpu->timer_id, wake);
+		}
+	}
+	detach_event(cpu->timer_id);
 	pthread_exit(NULL);
 }
 
-static void * ld_routine(void * args) {
+/* Next process to be loaded */
+static int ld_next = 0;
+/* Real-time processes waiting for admission, in load order */
+static struct pcb_t ** ld_deferred;
+static int ld_nr_deferred = 0;
+
+/* Admit the deferred real-time processes that fit by now */
+static void ld_admit_deferred(void) {
+	int i, kept = 0;
+	for (i = 0; i < ld_nr_deferred; i++) {
+		struct pcb_t * proc = ld_deferred[i];
+		if (edf_admit(proc, 1) > 0) {
+			printf("\tAdmitted process %2d\n", proc->pid);
+			add_proc(proc);
+			wake_parked_cpus(0);
+		}else{
+			ld_deferred[kept++] = proc;
+		}
+	}
+	ld_nr_deferred = kept;
+}
+
+/* Run the loader for one time slot, same return value as cpu_step() */
+static uint64_t ld_step(void * args) {
 #ifdef MM_PAGING
 	struct memphy_struct* mram = ((struct mmpaging_ld_args *)args)->mram;
 	struct memphy_struct** mswp = ((struct mmpaging_ld_args *)args)->mswp;
 	struct memphy_struct* active_mswp = ((struct mmpaging_ld_args *)args)->active_mswp;
-	struct timer_id_t * timer_id = ((struct mmpaging_ld_args *)args)->timer_id;
-#else
-	struct timer_id_t * timer_id = (struct timer_id_t*)args;
 #endif
-	int i = 0;
-	printf("ld_routine\n");
-	while (i < num_processes) {
-		struct pcb_t * proc = load(ld_processes.path[i]);
+	int i = ld_next;
+	if (ld_nr_deferred > 0) {
+		ld_admit_deferred();
+	}
+	if (i == num_processes && ld_nr_deferred > 0) {
+		return current_time() + 1;
+	}
+	if (i == num_processes) {
+		free(ld_processes.path);
+		free(ld_processes.start_time);
+		free(ld_processes.deadline);
+		free(ld_processes.period);
+		free(ld_processes.group);
+		free(ld_deferred);
+		done = 1;
+		wake_parked_cpus(0);
+		return SLOT_STOP;
+	}
+	if (current_time() < ld_processes.start_time[i]) {
+		return ld_nr_deferred > 0 ? current_time() + 1
+			: ld_processes.start_time[i];
+	}
+	struct pcb_t * proc = load(ld_processes.path[i]);
+	proc->arrival = current_time();
+	proc->first_run = SLOT_NEVER;
+	proc->run_slots = 0;
+	proc->last_cpu = -1;
 #ifdef MLQ_SCHED
-		proc->prio = ld_processes.prio[i];
+	proc->prio = ld_processes.prio[i];
 #endif
-		while (current_time() < ld_processes.start_time[i]) {
-			next_slot(timer_id);
-		}
 #ifdef MM_PAGING
-		proc->mm = malloc(sizeof(struct mm_struct));
+	proc->mm = malloc(sizeof(struct mm_struct));
 #ifdef MM_PAGING_HEAP_GODOWN
-		proc->vmemsz = vmemsz;
+	proc->vmemsz = vmemsz;
 #endif
-		init_mm(proc->mm, proc);
-		proc->mram = mram;
-		proc->mswp = mswp;
-		proc->active_mswp = active_mswp;
+	init_mm(proc->mm, proc);
+	proc->mram = mram;
+	proc->mswp = mswp;
+	proc->active_mswp = active_mswp;
 #endif
-		printf("\tLoaded a process at %s, PID: %d PRIO: %ld\n",
-			ld_processes.path[i], proc->pid, ld_processes.prio[i]);
+	proc->group = ld_processes.group[i];
+	proc->deadline = 0;
+	if (ld_processes.deadline[i] > 0) {
+		proc->deadline = ld_processes.start_time[i]
+			+ ld_processes.deadline[i];
+		proc->period = ld_processes.period[i];
+	}
+	printf("\tLoaded a process at %s, PID: %d PRIO: %ld\n",
+		ld_processes.path[i], proc->pid, ld_processes.prio[i]);
+
+	/* Real-time processes go through admission control */
+	int admitted = proc->deadline ? edf_admit(proc, 0) : 1;
+	if (admitted > 0) {
 		add_proc(proc);
-		free(ld_processes.path[i]);
-		i++;
-		next_slot(timer_id);
+		wake_parked_cpus(0);
+	}else if (admitted < 0) {
+		printf("\tDeferred process %2d\n", proc->pid);
+		ld_deferred[ld_nr_deferred++] = proc;
+	}else{
+		printf("\tRejected process %2d\n", proc->pid);
+		free_proc(proc);
+	}
+	free(ld_processes.path[i]);
+	ld_next++;
+	return current_time() + 1;
+}
+
+static void * ld_routine(void * args) {
+#ifdef MM_PAGING
+	struct timer_id_t * timer_id = ((struct mmpaging_ld_args *)args)->timer_id;
+#else
+	struct timer_id_t * timer_id = (struct timer_id_t*)args;
+#endif
+	uint64_t wake;
+	printf("ld_routine\n");
+	while ((wake = ld_step(args)) != SLOT_STOP) {
+		next_idle_slot(timer_id, wake);
 	}
-	free(ld_processes.path);
-	free(ld_processes.start_time);
-	done = 1;
 	detach_event(timer_id);
 	pthread_exit(NULL);
 }
 
+/*
+ * Single-threaded discrete-event engine
+ *
+ * Instead of one thread per device in lockstep, every device is a pending
+ * event in a min-heap keyed by (time slot, device). Device 0 is the loader
+ * and device i + 1 is CPU i, so inside a slot the loader always runs first
+ * and CPUs run in id order. Idle CPUs are put aside and re-armed at the
+ * next slot anything happens, which gives the same fast-forward behaviour
+ * as the threaded timer.
+ */
+struct sim_event {
+	uint64_t slot;
+	int dev;
+};
+
+static struct sim_event * ev_heap;
+static int ev_size = 0;
+
+static int ev_before(struct sim_event * a, struct sim_event * b) {
+	return a->slot < b->slot || (a->slot == b->slot && a->dev < b->dev);
+}
+
+static void ev_push(uint64_t slot, int dev) {
+	int i = ev_size++;
+	while (i > 0) {
+		int parent = (i - 1) / 2;
+		struct sim_event ev = { slot, dev };
+		if (!ev_before(&ev, &ev_heap[parent])) {
+			break;
+		}
+		ev_heap[i] = ev_heap[parent];
+		i = parent;
+	}
+	ev_heap[i].slot = slot;
+	ev_heap[i].dev = dev;
+}
+
+static struct sim_event ev_pop(void) {
+	struct sim_event top = ev_heap[0];
+	struct sim_event last = ev_heap[--ev_size];
+	int i = 0;
+	while (2 * i + 1 < ev_size) {
+		int child = 2 * i + 1;
+		if (child + 1 < ev_size
+				&& ev_before(&ev_heap[child + 1], &ev_heap[child])) {
+			child++;
+		}
+		if (!ev_before(&ev_heap[child], &last)) {
+			break;
+		}
+		ev_heap[i] = ev_heap[child];
+		i = child;
+	}
+	ev_heap[i] = last;
+	return top;
+}
+
+/*
+ * Parked CPUs
+ *
+ * A CPU with nothing to run while every run queue is empty parks: it
+ * leaves the slot barrier, the event heap or the block its worker steps,
+ * rather than being stepped every slot for nothing. Devices that queue
+ * work wake the parked CPUs up, so host time and barrier traffic follow
+ * the busy CPUs only. A CPU thread parks through park_event(), the event
+ * engine and workers flag the CPU [parked] with the same handshake.
+ */
+static int nr_parked = 0;	// CPUs flagged [parked], atomic
+
+static int cpu_can_park(void) {
+	return !__atomic_load_n(&done, __ATOMIC_RELAXED) && queue_empty();
+}
+
+/* Flag [cpu] as parked unless work shows up meanwhile, return 1 if it
+ * stays parked */
+static int cpu_park(struct cpu_args * cpu) {
+	int parked = 1;
+	__atomic_store_n(&cpu->parked, 1, __ATOMIC_SEQ_CST);
+	__atomic_add_fetch(&nr_parked, 1, __ATOMIC_SEQ_CST);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (cpu_can_park()) {
+		return 1;
+	}
+	/* Unless a waker has cleared it already */
+	if (__atomic_compare_exchange_n(&cpu->parked, &parked, 0, 0,
+			__ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+		__atomic_sub_fetch(&nr_parked, 1, __ATOMIC_SEQ_CST);
+	}
+	return 0;
+}
+
+/* Device [dev] (0 is the loader, i + 1 is CPU i) may have queued work in
+ * the current slot, or the loader is done: let the parked CPUs look at it.
+ * Every engine steps them in this slot if they come after [dev], as the
+ * event engine would have if they had never parked, else from the next */
+static void wake_parked_cpus(int dev) {
+	int i;
+	/* Pairs with the one in park_event() and cpu_park() */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (nr_workers == 0 && cpu_list[0].timer_id != NULL) {
+		if (parked_events() == 0 || cpu_can_park()) {
+			return;
+		}
+		for (i = 0; i < num_cpus; i++) {
+			unpark_event(cpu_list[i].timer_id, i + 1 > dev);
+		}
+		return;
+	}
+
+	if ((__atomic_load_n(&nr_parked, __ATOMIC_SEQ_CST) == 0
+			&& parked_events() == 0) || cpu_can_park()) {
+		return;
+	}
+	for (i = 0; i < num_cpus; i++) {
+		struct cpu_args * cpu = &cpu_list[i];
+		int parked = 1;
+		if (__atomic_compare_exchange_n(&cpu->parked, &parked, 0, 0,
+				__ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+			__atomic_sub_fetch(&nr_parked, 1, __ATOMIC_SEQ_CST);
+			if (cpu->timer_id == NULL) {
+				ev_push(current_time() + (i + 1 < dev), i + 1);
+			}
+		}
+		/* A worker may park with idle CPUs not flagged yet, wake
+		 * each worker once. It is parked only if [dev] is not one of
+		 * its CPUs, so all of them come after [dev] or none does */
+		if (cpu->timer_id != NULL && (i + 1 == num_cpus
+				|| cpu_list[i + 1].timer_id != cpu->timer_id)) {
+			unpark_event(cpu->timer_id, i + 1 > dev);
+		}
+	}
+}
+
+static void run_event_engine(struct cpu_args * cpus, void * ld_args) {
+	int * idle = (int*)malloc(sizeof(int) * num_cpus);
+	int nr_idle = 0;
+	uint64_t slot = 0;
+	int i;
+
+	ev_heap = (struct sim_event*)malloc(
+		sizeof(struct sim_event) * (num_cpus + 1));
+	ev_push(0, 0);
+	for (i = 0; i < num_cpus; i++) {
+		cpus[i].time_left = 0;
+		cpus[i].refill = 0;
+		cpus[i].proc = NULL;
+		ev_push(0, i + 1);
+	}
+
+	announce_slot(slot);
+	printf("ld_routine\n");
+	while (1) {
+		/* Step every device due in the current slot */
+		while (ev_size > 0 && ev_heap[0].slot == slot) {
+			struct sim_event ev = ev_pop();
+			uint64_t wake = ev.dev == 0 ?
+				ld_step(ld_args) : cpu_step(&cpus[ev.dev - 1]);
+			if (wake == SLOT_NEVER && ev.dev > 0
+					&& cpu_park(&cpus[ev.dev - 1])) {
+				continue;
+			}else if (wake == SLOT_NEVER) {
+				idle[nr_idle++] = ev.dev;
+			}else if (wake != SLOT_STOP) {
+				ev_push(wake, ev.dev);
+			}
+		}
+		if (ev_size == 0 && nr_idle == 0) {
+			break;
+		}
+
+		/* Idle CPUs follow the next slot something happens in */
+		if (ev_size == 0 || ev_heap[0].slot == SLOT_NEVER) {
+			slot++;
+		}else{
+			slot = ev_heap[0].slot;
+		}
+		for (i = 0; i < nr_idle; i++) {
+			ev_push(slot, idle[i]);
+		}
+		nr_idle = 0;
+		announce_slot(slot);
+	}
+	free(ev_heap);
+	free(idle);
+}
+
+/*
+ * Worker pool (--workers=N)
+ *
+ * Rather than one host thread per simulated CPU, N workers each step a
+ * block of consecutive CPUs, in id order, once per time slot and cross the
+ * slot barrier once for all of them. Worker 0 steps the loader first, so
+ * a single worker runs the devices in the order of the event engine. A
+ * worker whose CPUs are all idle parks as a CPU thread would.
+ */
+struct worker_args {
+	struct timer_id_t * timer_id;
+	struct cpu_args * cpus;	// First CPU of the block
+	int nr_cpus;
+	int loader;		// Only set for worker 0
+	void * ld_args;
+};
+
+static void * worker_routine(void * args) {
+	struct worker_args * worker = (struct worker_args*)args;
+	int * stopped = (int*)calloc(worker->nr_cpus, sizeof(int));
+	int nr_running = worker->nr_cpus;
+	int loading = worker->loader;
+	int i;
+	for (i = 0; i < worker->nr_cpus; i++) {
+		worker->cpus[i].time_left = 0;
+		worker->cpus[i].refill = 0;
+		worker->cpus[i].proc = NULL;
+	}
+	if (loading) {
+		printf("ld_routine\n");
+	}
+	while (loading || nr_running > 0) {
+		uint64_t wake = SLOT_NEVER;
+		if (loading) {
+			wake = ld_step(worker->ld_args);
+			loading = (wake != SLOT_STOP);
+			if (!loading) {
+				wake = SLOT_NEVER;
+			}
+		}
+		for (i = 0; i < worker->nr_cpus; i++) {
+			struct cpu_args * cpu = &worker->cpus[i];
+			if (stopped[i] || __atomic_load_n(&cpu->parked,
+					__ATOMIC_SEQ_CST)) {
+				continue;
+			}
+			uint64_t cpu_wake = cpu_step(cpu);
+			if (cpu_wake == SLOT_STOP) {
+				stopped[i] = 1;
+				nr_running--;
+			}else if (cpu_wake == SLOT_NEVER && cpu_park(cpu)) {
+				continue;
+			}else if (cpu_wake < wake) {
+				wake = cpu_wake;
+			}
+		}
+		if (!loading && nr_running == 0) {
+			break;
+		}
+		if (wake == SLOT_NEVER) {
+			park_event(worker->timer_id, cpu_can_park);
+		}else{
+			next_idle_slot(worker->timer_id, wake);
+		}
+	}
+	free(stopped);
+	detach_event(worker->timer_id);
+	pthread_exit(NULL);
+}
+
 static void read_config(const char * path) {
 	FILE * file;
 	if ((file = fopen(path, "r")) == NULL) {
@@ -190,46 +585,153 @@ static void read_config(const char * path) {
 	ld_processes.prio = (unsigned long*)
 		malloc(sizeof(unsigned long) * num_processes);
 #endif
+	ld_processes.deadline = (unsigned long*)
+		calloc(num_processes, sizeof(unsigned long));
+	ld_processes.period = (unsigned long*)
+		calloc(num_processes, sizeof(unsigned long));
+	ld_processes.group = (int*)malloc(sizeof(int) * num_processes);
+	ld_deferred = (struct pcb_t**)
+		malloc(sizeof(struct pcb_t*) * num_processes);
+	int group = 0;
 	int i;
 	for (i = 0; i < num_processes; i++) {
 		ld_processes.path[i] = (char*)malloc(sizeof(char) * 100);
 		ld_processes.path[i][0] = '\0';
 		strcat(ld_processes.path[i], "input/proc/");
 		char proc[100];
+		/* [start time] [path] [priority] [deadline] [period], the
+		 * priority and the real-time parameters are optional. A
+		 * "group [name] [shares]" line puts the processes after it
+		 * in that group */
+		char line[256];
+		unsigned long prio = 0;
+		unsigned int shares;
+		int nr_fields = 0;
+		while (nr_fields <= 0 && fgets(line, sizeof(line), file) != NULL) {
+			if (sscanf(line, " group %99s %u", proc, &shares) == 2) {
+				group = sched_add_group(proc, shares);
+				if (group < 0) {
+					printf("[READ_CONFIG] Error: cannot add "
+						"group %s\n", proc);
+					exit(1);
+				}
+				continue;
+			}
+			nr_fields = sscanf(line, "%lu %99s %lu %lu %lu",
+				&ld_processes.start_time[i], proc, &prio,
+				&ld_processes.deadline[i],
+				&ld_processes.period[i]);
+		}
+		ld_processes.group[i] = group;
+		if (nr_fields < 2) {
+			printf("[READ_CONFIG] Error: missing process %d in %s\n",
+				i + 1, path);
+			exit(1);
+		}
 #ifdef MLQ_SCHED
-		fscanf(file, "%lu %s %lu\n", &ld_processes.start_time[i], proc, &ld_processes.prio[i]);
-#else
-		fscanf(file, "%lu %s\n", &ld_processes.start_time[i], proc);
+		ld_processes.prio[i] = prio;
 #endif
+		if (ld_processes.period[i] == 0) {
+			ld_processes.period[i] = ld_processes.deadline[i];
+		}
 		strcat(ld_processes.path[i], proc);
 	}
 }
 
 int main(int argc, char * argv[]) {
-	/* Read config */
-	if (argc != 2) {
-		printf("Usage: os [path to configure file]\n");
+	/* Read options and config */
+	static struct option options[] = {
+		{"sim", required_argument, NULL, 's'},
+		{"sched", required_argument, NULL, 'p'},
+		{"csv", required_argument, NULL, 'c'},
+		{"preempt", no_argument, NULL, 'e'},
+		{"workers", required_argument, NULL, 'w'},
+		{"pgrepl", required_argument, NULL, 'r'},
+		{"lock-times", no_argument, NULL, 't'},
+		{NULL, 0, NULL, 0}
+	};
+	int event_engine = 0;
+	const char * csv = NULL;
+	int opt;
+	while ((opt = getopt_long(argc, argv, "s:p:c:ew:r:t", options, NULL)) != -1) {
+		if (opt == 's' && !strcmp(optarg, "event")) {
+			event_engine = 1;
+		}else if (opt == 's' && !strcmp(optarg, "pool")) {
+			nr_workers = nr_workers ? nr_workers : -1;
+		}else if (opt == 'w' && atoi(optarg) > 0) {
+			nr_workers = atoi(optarg);
+		}else if (opt == 'p' && set_scheduler(optarg) == 0) {
+			continue;
+		}else if (opt == 'r' && set_pgrepl(optarg) == 0) {
+			continue;
+		}else if (opt == 'c') {
+			csv = optarg;
+		}else if (opt == 'e') {
+			sched_set_preempt(1);
+		}else if (opt == 't') {
+			sched_set_lock_times(1);
+		}else if (opt != 's' || strcmp(optarg, "thread")) {
+			optind = argc;
+			break;
+		}
+	}
+	if (optind != argc - 1) {
+		printf("Usage: os [--sim=thread|event|pool] [--workers=N]"
+			" [--sched=fifo|rr|mlq|cfs|mlfq|srtf]"
+			" [--preempt] [--pgrepl=fifo|clock|lru|lfu]"
+			" [--csv=metrics file] [--lock-times]"
+			" [path to configure file]\n");
 		return 1;
 	}
 	char path[100];
 	path[0] = '\0';
 	strcat(path, "input/");
-	strcat(path, argv[1]);
+	strcat(path, argv[optind]);
 	read_config(path);
 
 	pthread_t * cpu = (pthread_t*)malloc(num_cpus * sizeof(pthread_t));
 	struct cpu_args * args =
 		(struct cpu_args*)malloc(sizeof(struct cpu_args) * num_cpus);
 	pthread_t ld;
+	cpu_list = args;
+
+	/* The event engine runs everything on this thread */
+	if (event_engine) {
+		nr_workers = 0;
+	}else if (nr_workers < 0) {
+		nr_workers = sysconf(_SC_NPROCESSORS_ONLN);
+	}
+	if (nr_workers > num_cpus) {
+		nr_workers = num_cpus;
+	}
+	struct worker_args * workers = (struct worker_args*)
+		malloc(sizeof(struct worker_args) * (nr_workers + 1));
 	
-	/* Init timer */
-	int i;
+	/* Init timer, the event engine steps devices by itself and workers
+	 * are attached in place of the CPUs and the loader they step */
+	int i, j;
 	for (i = 0; i < num_cpus; i++) {
-		args[i].timer_id = attach_event();
+		args[i].timer_id = event_engine || nr_workers > 0 ?
+			NULL : attach_event();
 		args[i].id = i;
+		args[i].parked = 0;
+	}
+	for (i = 0; i < nr_workers; i++) {
+		workers[i].timer_id = attach_event();
+		workers[i].cpus = &args[i * num_cpus / nr_workers];
+		workers[i].nr_cpus = (i + 1) * num_cpus / nr_workers
+			- i * num_cpus / nr_workers;
+		workers[i].loader = (i == 0);
+		/* Parking and waking go through the worker */
+		for (j = 0; j < workers[i].nr_cpus; j++) {
+			workers[i].cpus[j].timer_id = workers[i].timer_id;
+		}
+	}
+	struct timer_id_t * ld_event = event_engine || nr_workers > 0 ?
+		NULL : attach_event();
+	if (!event_engine) {
+		start_timer();
 	}
-	struct timer_id_t * ld_event = attach_event();
-	start_timer();
 
 #ifdef MM_PAGING
 	/* Init all MEMPHY include 1 MEMRAM and n of MEMSWP */
@@ -240,7 +742,6 @@ int main(int argc, char * argv[]) {
 
 	/* Create MEM RAM */
 	init_memphy(&mram, memramsz, rdmflag);
-	pthread_mutex_init(&swap_lock, NULL);
         /* Create all MEM SWAP */ 
 	int sit;
 	for(sit = 0; sit < PAGING_MAX_MMSWP; sit++)
@@ -260,27 +761,66 @@ int main(int argc, char * argv[]) {
 
 
 	/* Init scheduler */
-	init_scheduler();
+	sched_set_time_slot(time_slot);
+	init_scheduler(num_cpus);
+	init_metrics(num_cpus);
+#ifdef MM_TLB
+	init_tlb(num_cpus);
+#endif
 
 	/* Run CPU and loader */
 #ifdef MM_PAGING
-	pthread_create(&ld, NULL, ld_routine, (void*)mm_ld_args);
+	void * ld_args = (void*)mm_ld_args;
 #else
-	pthread_create(&ld, NULL, ld_routine, (void*)ld_event);
+	void * ld_args = (void*)ld_event;
 #endif
-	for (i = 0; i < num_cpus; i++) {
-		pthread_create(&cpu[i], NULL,
-			cpu_routine, (void*)&args[i]);
+	if (event_engine) {
+		run_event_engine(args, ld_args);
+		finish_scheduler();
+		finish_metrics(csv);
+#ifdef MM_TLB
+		finish_tlb();
+#endif
+#ifdef MM_PAGING
+		finish_pgrepl();
+#endif
+		return 0;
 	}
+	if (nr_workers > 0) {
+		/* Workers take the place of CPU threads */
+		for (i = 0; i < nr_workers; i++) {
+			workers[i].ld_args = ld_args;
+			pthread_create(&cpu[i], NULL,
+				worker_routine, (void*)&workers[i]);
+		}
+		for (i = 0; i < nr_workers; i++) {
+			pthread_join(cpu[i], NULL);
+		}
+	}else{
+		pthread_create(&ld, NULL, ld_routine, ld_args);
+		for (i = 0; i < num_cpus; i++) {
+			pthread_create(&cpu[i], NULL,
+				cpu_routine, (void*)&args[i]);
+		}
 
-	/* Wait for CPU and loader finishing */
-	for (i = 0; i < num_cpus; i++) {
-		pthread_join(cpu[i], NULL);
+		/* Wait for CPU and loader finishing */
+		for (i = 0; i < num_cpus; i++) {
+			pthread_join(cpu[i], NULL);
+		}
+		pthread_join(ld, NULL);
 	}
-	pthread_join(ld, NULL);
+	free(workers);
 
 	/* Stop timer */
 	stop_timer();
+	finish_scheduler();
+	finish_metrics(csv);
+#ifdef MM_TLB
+	finish_tlb();
+#endif
+#ifdef MM_PAGING
+	finish_pgrepl();
+#endif
 
 	return 0;
 
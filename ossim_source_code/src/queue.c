@@ -2,17 +2,85 @@
 #include <stdlib.h>
 #include "queue.h"
 
+/*
+ * Ready queue as a binary min-heap of (key, seq). The key orders the
+ * processes, the sequence number taken at enqueue time keeps processes
+ * with equal keys in FIFO order. Every queued PCB remembers its slot in
+ * the heap (pcb_t.q_index), so it can be removed or re-keyed in O(log n).
+ */
+
+/* Processes lost because a queue could not grow, zero unless we run out
+ * of host memory */
+static unsigned long nr_dropped = 0;
+
+static int node_before(struct queue_node * a, struct queue_node * b) {
+	return a->key < b->key || (a->key == b->key && a->seq < b->seq);
+}
+
+static void node_set(struct queue_t * q, int i, struct queue_node node) {
+	q->heap[i] = node;
+	node.proc->q_index = i;
+}
+
+static void sift_up(struct queue_t * q, int i) {
+	struct queue_node node = q->heap[i];
+	while (i > 0) {
+		int parent = (i - 1) / 2;
+		if (!node_before(&node, &q->heap[parent])) {
+			break;
+		}
+		node_set(q, i, q->heap[parent]);
+		i = parent;
+	}
+	node_set(q, i, node);
+}
+
+static void sift_down(struct queue_t * q, int i) {
+	struct queue_node node = q->heap[i];
+	while (2 * i + 1 < q->size) {
+		int child = 2 * i + 1;
+		if (child + 1 < q->size
+				&& node_before(&q->heap[child + 1], &q->heap[child])) {
+			child++;
+		}
+		if (!node_before(&q->heap[child], &node)) {
+			break;
+		}
+		node_set(q, i, q->heap[child]);
+		i = child;
+	}
+	node_set(q, i, node);
+}
+
 int empty(struct queue_t * q) {
         if (q == NULL) return 1;
 	return (q->size == 0);
 }
 
+void enqueue_key(struct queue_t * q, struct pcb_t * proc, uint64_t key) {
+	if (q->size == q->capacity) {
+		/* Double the storage, starting with MAX_QUEUE_SIZE slots */
+		int capacity = q->capacity ? 2 * q->capacity : MAX_QUEUE_SIZE;
+		struct queue_node * heap = (struct queue_node *)realloc(q->heap,
+			sizeof(struct queue_node) * capacity);
+		if (heap == NULL) {
+			printf("[ENQUEUE] Error: Cannot grow queue, process %d dropped.\n",
+				proc->pid);
+			__atomic_add_fetch(&nr_dropped, 1, __ATOMIC_RELAXED);
+			return;
+		}
+		q->heap = heap;
+		q->capacity = capacity;
+	}
+	struct queue_node node = { key, q->seq++, proc };
+	node_set(q, q->size, node);
+	q->size++;
+	sift_up(q, q->size - 1);
+}
+
 void enqueue(struct queue_t * q, struct pcb_t * proc) {
         /* TODO: put a new process to queue [q] */
-	if(q->size < MAX_QUEUE_SIZE && q->size >= 0) {
-        	q->proc[q->size] = proc;
-       		q->size++;
-    }
+	enqueue_key(q, proc, QUEUE_PRIO_KEY(proc->priority));
 }
 
 struct pcb_t * dequeue(struct queue_t * q) {
@@ -20,22 +88,54 @@ struct pcb_t * dequeue(struct queue_t * q) {
          * in the queue [q] and remember to remove it from q
          * */
 	if(q->size == 0) {
-        return NULL;
-    }
-
-    int highest_priority_index = 0;
-    for(int i = 0; i < q->size; i++) {
-        if(q->proc[i]->priority > q->proc[highest_priority_index]->priority) {
-            highest_priority_index = i;
-        }
-    }
-
-    struct pcb_t* highest_priority_pcb = q->proc[highest_priority_index];
-
-    for(int i = highest_priority_index + 1; i < q->size; i++) {
-        q->proc[i - 1] = q->proc[i];
-    }
-    q->size--;
-    return highest_priority_pcb;
+		return NULL;
+	}
+	struct pcb_t * proc = q->heap[0].proc;
+	queue_remove(q, proc);
+	return proc;
+}
+
+struct pcb_t * queue_peek(struct queue_t * q) {
+	return q->size == 0 ? NULL : q->heap[0].proc;
+}
+
+struct pcb_t * queue_find(struct queue_t * q, int depth,
+		int (*match)(struct pcb_t * proc, int arg), int arg) {
+	struct queue_node * found = NULL;
+	int i;
+	if (depth > q->size) {
+		depth = q->size;
+	}
+	for (i = 0; i < depth; i++) {
+		struct queue_node * node = &q->heap[i];
+		if (node->key == q->heap[0].key && match(node->proc, arg)
+				&& (found == NULL || node->seq < found->seq)) {
+			found = node;
+		}
+	}
+	return found == NULL ? NULL : found->proc;
+}
+
+void queue_remove(struct queue_t * q, struct pcb_t * proc) {
+	int i = proc->q_index;
+	q->size--;
+	if (i != q->size) {
+		/* Fill the hole with the last node and restore the order */
+		struct pcb_t * moved = q->heap[q->size].proc;
+		node_set(q, i, q->heap[q->size]);
+		sift_up(q, i);
+		sift_down(q, moved->q_index);
+	}
+}
+
+void queue_set_key(struct queue_t * q, struct pcb_t * proc, uint64_t key) {
+	int i = proc->q_index;
+	q->heap[i].key = key;
+	sift_up(q, i);
+	sift_down(q, proc->q_index);
+}
+
+unsigned long queue_dropped(void) {
+	return __atomic_load_n(&nr_dropped, __ATOMIC_RELAXED);
 }
 
@@ -0,0 +1,205 @@
+/*
+ * Completely-fair scheduling policy
+ * sched/sched-cfs.c
+ *
+ * Every process accumulates a virtual runtime: one time slot of real
+ * execution weighted by the inverse of its load weight, which is derived
+ * from [prio] the way nice levels are in Linux. Each CPU keeps its
+ * runnable processes ordered by virtual runtime and always dispatches the
+ * one that received the least CPU so far. The time slice is not the fixed
+ * time_slot of the config but the share of CFS_SCHED_LATENCY the process
+ * is entitled to among the runnable ones, never below
+ * CFS_MIN_GRANULARITY. Selected with --sched=cfs.
+ */
+
+#include "queue.h"
+#include "sched.h"
+#include <pthread.h>
+#include <stdlib.h>
+
+#define NICE_0_LOAD 1024
+
+/* Linux sched_prio_to_weight[], nice -20 .. 19 */
+static const int prio_to_weight[40] = {
+	88761, 71755, 56483, 46273, 36291,
+	29154, 23254, 18705, 14949, 11916,
+	 9548,  7620,  6100,  4904,  3906,
+	 3121,  2501,  1991,  1586,  1277,
+	 1024,   820,   655,   526,   423,
+	  335,   272,   215,   172,   137,
+	  110,    87,    70,    56,    45,
+	   36,    29,    23,    18,    15,
+};
+
+struct cfs_rq {
+	struct sched_lock lock;
+	struct queue_t tasks;	// Runnable processes keyed by vruntime
+	uint64_t min_vruntime;	// Monotonic floor for newcomers
+	unsigned long load;	// Sum of the weights of [tasks]
+	int nr_queued;		// Size of [tasks], read without lock
+};
+
+static struct cfs_rq * cfs_rqs;
+static int cfs_nr_cpus;
+
+/* Spread the MAX_PRIO levels over the 40 nice levels */
+static int cfs_weight(struct pcb_t * proc) {
+	uint32_t prio = proc->prio < MAX_PRIO ? proc->prio : MAX_PRIO - 1;
+	return prio_to_weight[prio * 40 / MAX_PRIO];
+}
+
+static void cfs_enqueue(struct cfs_rq * rq, struct pcb_t * proc) {
+	enqueue_key(&rq->tasks, proc, proc->vruntime);
+	rq->load += cfs_weight(proc);
+	__atomic_add_fetch(&rq->nr_queued, 1, __ATOMIC_RELAXED);
+}
+
+static struct pcb_t * cfs_dequeue(struct cfs_rq * rq) {
+	struct pcb_t * proc = dequeue(&rq->tasks);
+	if (proc == NULL) {
+		return NULL;
+	}
+	rq->load -= cfs_weight(proc);
+	__atomic_sub_fetch(&rq->nr_queued, 1, __ATOMIC_RELAXED);
+	if (proc->vruntime > rq->min_vruntime) {
+		rq->min_vruntime = proc->vruntime;
+	}
+	return proc;
+}
+
+static int cfs_nr_queued(int cpu) {
+	return __atomic_load_n(&cfs_rqs[cpu].nr_queued, __ATOMIC_RELAXED);
+}
+
+static void init_cfs_scheduler(int num_cpus) {
+	int cpu;
+	cfs_nr_cpus = num_cpus;
+	cfs_rqs = (struct cfs_rq*)calloc(num_cpus, sizeof(struct cfs_rq));
+	for (cpu = 0; cpu < num_cpus; cpu++) {
+		sched_lock_init(&cfs_rqs[cpu].lock);
+	}
+}
+
+static int cfs_queue_empty(void) {
+	int cpu;
+	for (cpu = 0; cpu < cfs_nr_cpus; cpu++) {
+		if (cfs_nr_queued(cpu) > 0) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static struct pcb_t * get_cfs_proc(int cpu) {
+	struct cfs_rq * rq = &cfs_rqs[cpu];
+	struct pcb_t * proc;
+
+	sched_lock(&rq->lock, cpu);
+	proc = cfs_dequeue(rq);
+	sched_unlock(&rq->lock, cpu);
+	if (proc != NULL) {
+		return proc;
+	}
+
+	/* Nothing left locally, pull the leftmost process of the busiest
+	 * peer and rebase its vruntime onto our own timeline */
+	int victim = -1;
+	int most = 0;
+	int i;
+	for (i = 0; i < cfs_nr_cpus; i++) {
+		int nr = cfs_nr_queued(i);
+		if (i != cpu && nr > most) {
+			victim = i;
+			most = nr;
+		}
+	}
+	if (victim < 0) {
+		return NULL;
+	}
+
+	struct cfs_rq * src = &cfs_rqs[victim];
+	sched_lock(&src->lock, cpu);
+	/* Its lead is taken over the floor before the dequeue, which moves
+	 * the floor up to it. One put back below the floor has no lead */
+	uint64_t floor = src->min_vruntime;
+	proc = cfs_dequeue(src);
+	if (proc != NULL) {
+		proc->vruntime = proc->vruntime > floor
+			? proc->vruntime - floor : 0;
+	}
+	sched_unlock(&src->lock, cpu);
+	if (proc != NULL) {
+		sched_lock(&rq->lock, cpu);
+		proc->vruntime += rq->min_vruntime;
+		sched_unlock(&rq->lock, cpu);
+		sched_count_steal(cpu);
+	}
+	return proc;
+}
+
+static void put_cfs_proc(int cpu, struct pcb_t * proc) {
+	struct cfs_rq * rq = &cfs_rqs[cpu];
+	sched_lock(&rq->lock, cpu);
+	cfs_enqueue(rq, proc);
+	sched_unlock(&rq->lock, cpu);
+}
+
+static void add_cfs_proc(struct pcb_t * proc) {
+	/* New processes go to the least loaded CPU and start from its
+	 * current floor, so they neither starve nor get starved */
+	int cpu = 0;
+	int i;
+	for (i = 1; i < cfs_nr_cpus; i++) {
+		if (cfs_nr_queued(i) < cfs_nr_queued(cpu)) {
+			cpu = i;
+		}
+	}
+
+	struct cfs_rq * rq = &cfs_rqs[cpu];
+	sched_lock(&rq->lock, -1);
+	proc->vruntime = rq->min_vruntime;
+	cfs_enqueue(rq, proc);
+	sched_unlock(&rq->lock, -1);
+}
+
+static void prepare_cfs_proc(struct pcb_t * proc) {
+	/* Only matters for processes handed over on preemption, which skip
+	 * add_cfs_proc(): start from the floor of the least loaded CPU */
+	int cpu = 0;
+	int i;
+	for (i = 1; i < cfs_nr_cpus; i++) {
+		if (cfs_nr_queued(i) < cfs_nr_queued(cpu)) {
+			cpu = i;
+		}
+	}
+	proc->vruntime = __atomic_load_n(&cfs_rqs[cpu].min_vruntime,
+			__ATOMIC_RELAXED);
+}
+
+static int cfs_quantum(int cpu, struct pcb_t * proc) {
+	struct cfs_rq * rq = &cfs_rqs[cpu];
+	unsigned long weight = cfs_weight(proc);
+	int slice;
+
+	sched_lock(&rq->lock, cpu);
+	slice = CFS_SCHED_LATENCY * weight / (rq->load + weight);
+	sched_unlock(&rq->lock, cpu);
+	return slice < CFS_MIN_GRANULARITY ? CFS_MIN_GRANULARITY : slice;
+}
+
+static void cfs_tick(int cpu, struct pcb_t * proc) {
+	/* The running process is in no queue, only its CPU touches it */
+	proc->vruntime += ((uint64_t)NICE_0_LOAD << 10) / cfs_weight(proc);
+}
+
+const struct sched_class cfs_sched_class = {
+	.name = "cfs",
+	.init = init_cfs_scheduler,
+	.get = get_cfs_proc,
+	.put = put_cfs_proc,
+	.add = add_cfs_proc,
+	.empty = cfs_queue_empty,
+	.quantum = cfs_quantum,
+	.tick = cfs_tick,
+	.prepare = prepare_cfs_proc,
+};
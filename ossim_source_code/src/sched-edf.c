@@ -0,0 +1,168 @@
+/*
+ * Earliest-deadline-first real-time class
+ * sched/sched-edf.c
+ *
+ * A process whose config line carries a deadline is real-time: it runs
+ * ahead of every process of the selected policy, earliest absolute
+ * deadline first, from one global heap. It is not time sliced: it runs
+ * until it finishes or one with an earlier deadline is queued. Its
+ * utilization is its code size over its period (the relative deadline
+ * when no period is given). The loader admits it only while the total
+ * utilization of the admitted real-time processes stays within the
+ * number of CPUs, the rest is deferred until enough of them finished, or
+ * rejected.
+ */
+
+#include "queue.h"
+#include "sched.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Utilization is counted in 1/UTIL_SCALE of a CPU */
+#define UTIL_SCALE 1024
+
+struct edf_miss {
+	uint32_t pid;
+	uint64_t deadline;
+	uint64_t finish;
+};
+
+static struct queue_t edf_queue;
+static struct sched_lock edf_lock;
+static int edf_nr_queued = 0;		// Read without lock
+static int edf_nr_cpus;
+static unsigned long edf_util = 0;	// Admitted utilization, atomic
+
+/* Statistics, protected by [edf_lock] */
+static unsigned long nr_admitted = 0;
+static unsigned long nr_rejected = 0;
+static unsigned long nr_deferred = 0;
+static unsigned long nr_finished = 0;
+static struct edf_miss * misses = NULL;
+static int nr_misses = 0;
+
+static unsigned long edf_util_of(struct pcb_t * proc) {
+	return ((unsigned long)proc->code->size * UTIL_SCALE
+		+ proc->period - 1) / proc->period;
+}
+
+int edf_admit(struct pcb_t * proc, int retry) {
+	unsigned long util = edf_util_of(proc);
+	unsigned long total = __atomic_load_n(&edf_util, __ATOMIC_RELAXED);
+	int admitted = 0;
+
+	/* Only the loader admits, CPUs only ever lower [edf_util] */
+	if (total + util <= (unsigned long)edf_nr_cpus * UTIL_SCALE) {
+		__atomic_add_fetch(&edf_util, util, __ATOMIC_RELAXED);
+		admitted = 1;
+	}
+	sched_lock(&edf_lock, -1);
+	if (admitted) {
+		nr_admitted++;
+#ifdef EDF_ADMISSION_DEFER
+	/* A process too heavy on its own would wait forever */
+	}else if (util <= (unsigned long)edf_nr_cpus * UTIL_SCALE) {
+		nr_deferred += !retry;
+		admitted = -1;
+#endif
+	}else{
+		nr_rejected++;
+	}
+	sched_unlock(&edf_lock, -1);
+	return admitted;
+}
+
+void edf_finish(int cpu, struct pcb_t * proc) {
+	__atomic_sub_fetch(&edf_util, edf_util_of(proc), __ATOMIC_RELAXED);
+	sched_lock(&edf_lock, cpu);
+	nr_finished++;
+	if (proc->finish > proc->deadline) {
+		struct edf_miss * grown = (struct edf_miss*)realloc(misses,
+				(nr_misses + 1) * sizeof(struct edf_miss));
+		if (grown != NULL) {
+			misses = grown;
+			misses[nr_misses].pid = proc->pid;
+			misses[nr_misses].deadline = proc->deadline;
+			misses[nr_misses].finish = proc->finish;
+			nr_misses++;
+		}
+	}
+	sched_unlock(&edf_lock, cpu);
+}
+
+static void init_edf(int num_cpus) {
+	edf_nr_cpus = num_cpus;
+	edf_queue.size = 0;
+	sched_lock_init(&edf_lock);
+}
+
+static int edf_empty(void) {
+	return __atomic_load_n(&edf_nr_queued, __ATOMIC_RELAXED) == 0;
+}
+
+static struct pcb_t * get_edf_proc(int cpu) {
+	struct pcb_t * proc;
+	/* Called before every pick, keep the common case lock free */
+	if (edf_empty()) {
+		return NULL;
+	}
+	sched_lock(&edf_lock, cpu);
+	proc = dequeue(&edf_queue);
+	if (proc != NULL) {
+		__atomic_sub_fetch(&edf_nr_queued, 1, __ATOMIC_RELAXED);
+	}
+	sched_unlock(&edf_lock, cpu);
+	return proc;
+}
+
+int edf_preempts(struct pcb_t * proc) {
+	int earlier;
+	/* Asked every slot, only real-time processes look at the queue */
+	if (!proc->deadline || edf_empty()) {
+		return 0;
+	}
+	sched_lock(&edf_lock, -1);
+	earlier = edf_queue.size > 0 && edf_queue.heap[0].key < proc->deadline;
+	sched_unlock(&edf_lock, -1);
+	return earlier;
+}
+
+static void put_edf_proc(int cpu, struct pcb_t * proc) {
+	sched_lock(&edf_lock, cpu);
+	enqueue_key(&edf_queue, proc, proc->deadline);
+	__atomic_add_fetch(&edf_nr_queued, 1, __ATOMIC_RELAXED);
+	sched_unlock(&edf_lock, cpu);
+}
+
+static void add_edf_proc(struct pcb_t * proc) {
+	put_edf_proc(-1, proc);
+}
+
+static void edf_report(void) {
+	int i;
+	if (nr_admitted + nr_rejected == 0) {
+		return;
+	}
+	printf("Real-time processes (EDF)\n");
+	printf("\tadmitted: %lu, deferred: %lu, rejected: %lu\n",
+		nr_admitted, nr_deferred, nr_rejected);
+	printf("\tdeadline misses: %d of %lu finished\n",
+		nr_misses, nr_finished);
+	for (i = 0; i < nr_misses; i++) {
+		printf("\t\tPID %2d: deadline %lu, finished %lu, late %lu\n",
+			misses[i].pid, misses[i].deadline, misses[i].finish,
+			misses[i].finish - misses[i].deadline);
+	}
+	free(misses);
+}
+
+const struct sched_class edf_sched_class = {
+	.name = "edf",
+	.init = init_edf,
+	.get = get_edf_proc,
+	.put = put_edf_proc,
+	.add = add_edf_proc,
+	.empty = edf_empty,
+	.report = edf_report,
+};
+
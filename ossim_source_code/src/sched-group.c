@@ -0,0 +1,217 @@
+/*
+ * Fair-share CPU groups
+ * sched/sched-group.c
+ *
+ * A "group [name] [shares]" line of the config puts the processes that
+ * follow it in a group, as cgroups do. Every slot a process runs charges
+ * its group GROUP_VTIME_SCALE / shares of virtual time, so a group with
+ * twice the shares may use twice the CPU for the same virtual time. The
+ * MLQ policy first picks the waiting group with the least virtual time,
+ * then a process of that group by its usual rules: however many processes
+ * a group floods the system with, it only ever gets its share. A group
+ * that had nothing to run does not bank credit, when it gets a process
+ * again its virtual time is raised to the least one of the busy groups.
+ */
+
+#include "sched.h"
+#include "timer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define GROUP_VTIME_SCALE (1UL << 20)
+#define GROUP_NAME_LEN 16
+
+struct sched_group {
+	char name[GROUP_NAME_LEN];
+	unsigned int shares;
+	uint64_t vtime;		// Atomic
+	int nr_running;		// Loaded and not finished yet, atomic
+	int nr_loaded;		// Only the loader writes it
+};
+
+/* Slots used per window and group, each CPU only writes its own */
+struct group_usage {
+	unsigned long * slots;	// [window * SCHED_MAX_GROUPS + group]
+	int nr_windows;
+};
+
+static struct sched_group groups[SCHED_MAX_GROUPS] = {
+	{ "default", SCHED_GROUP_SHARES },
+};
+static int nr_groups = 1;
+static struct group_usage * group_usage;
+static int group_nr_cpus;
+
+int sched_add_group(const char * name, unsigned int shares) {
+	int i;
+	/* A truncated name could collide with another group */
+	if (strlen(name) >= GROUP_NAME_LEN) {
+		return -1;
+	}
+	for (i = 0; i < nr_groups; i++) {
+		if (!strcmp(groups[i].name, name)) {
+			return i;
+		}
+	}
+	if (nr_groups == SCHED_MAX_GROUPS || shares == 0) {
+		return -1;
+	}
+	struct sched_group * group = &groups[nr_groups];
+	strncpy(group->name, name, GROUP_NAME_LEN - 1);
+	group->shares = shares;
+	return nr_groups++;
+}
+
+int sched_nr_groups(void) {
+	return nr_groups;
+}
+
+uint64_t group_vtime(int group) {
+	return __atomic_load_n(&groups[group].vtime, __ATOMIC_RELAXED);
+}
+
+void init_groups(int num_cpus) {
+	group_nr_cpus = num_cpus;
+	group_usage = (struct group_usage*)calloc(num_cpus,
+			sizeof(struct group_usage));
+}
+
+void group_enter(struct pcb_t * proc) {
+	struct sched_group * group = &groups[proc->group];
+	group->nr_loaded++;
+	if (__atomic_fetch_add(&group->nr_running, 1, __ATOMIC_RELAXED) > 0) {
+		return;
+	}
+
+	/* Back from idle, catch up with the busy groups */
+	uint64_t least = UINT64_MAX;
+	int i;
+	for (i = 0; i < nr_groups; i++) {
+		if (&groups[i] != group && __atomic_load_n(
+				&groups[i].nr_running, __ATOMIC_RELAXED) > 0
+				&& group_vtime(i) < least) {
+			least = group_vtime(i);
+		}
+	}
+	if (least != UINT64_MAX && group->vtime < least) {
+		__atomic_store_n(&group->vtime, least, __ATOMIC_RELAXED);
+	}
+}
+
+void group_exit(struct pcb_t * proc) {
+	__atomic_sub_fetch(&groups[proc->group].nr_running, 1,
+			__ATOMIC_RELAXED);
+}
+
+void group_charge(int cpu, struct pcb_t * proc) {
+	struct group_usage * usage = &group_usage[cpu];
+	int window = current_time() / SCHED_GROUP_WINDOW;
+
+	/* Only the default group, nothing to share or report */
+	if (nr_groups == 1) {
+		return;
+	}
+	__atomic_add_fetch(&groups[proc->group].vtime,
+			GROUP_VTIME_SCALE / groups[proc->group].shares,
+			__ATOMIC_RELAXED);
+	if (window >= usage->nr_windows) {
+		int nr = usage->nr_windows ? 2 * usage->nr_windows : 16;
+		while (nr <= window) {
+			nr *= 2;
+		}
+		unsigned long * slots = (unsigned long*)realloc(usage->slots,
+				nr * SCHED_MAX_GROUPS * sizeof(unsigned long));
+		if (slots == NULL) {
+			printf("[GROUP_CHARGE] Error: out of memory, "
+				"slot %d not recorded\n", window);
+			return;
+		}
+		memset(slots + usage->nr_windows * SCHED_MAX_GROUPS, 0,
+			(nr - usage->nr_windows) * SCHED_MAX_GROUPS
+			* sizeof(unsigned long));
+		usage->slots = slots;
+		usage->nr_windows = nr;
+	}
+	usage->slots[window * SCHED_MAX_GROUPS + proc->group]++;
+}
+
+/* Slots group [group] used in window [window] on all CPUs */
+static unsigned long group_slots(int window, int group) {
+	unsigned long slots = 0;
+	int cpu;
+	for (cpu = 0; cpu < group_nr_cpus; cpu++) {
+		if (window < group_usage[cpu].nr_windows) {
+			slots += group_usage[cpu].slots[window
+				* SCHED_MAX_GROUPS + group];
+		}
+	}
+	return slots;
+}
+
+void report_groups(void) {
+	unsigned long total[SCHED_MAX_GROUPS] = { 0 };
+	unsigned long all = 0;
+	int nr_windows = 0;
+	int cpu, window, i;
+
+	if (nr_groups > 1) {
+		for (cpu = 0; cpu < group_nr_cpus; cpu++) {
+			if (group_usage[cpu].nr_windows > nr_windows) {
+				nr_windows = group_usage[cpu].nr_windows;
+			}
+		}
+		for (window = 0; window < nr_windows; window++) {
+			for (i = 0; i < nr_groups; i++) {
+				total[i] += group_slots(window, i);
+			}
+		}
+		for (i = 0; i < nr_groups; i++) {
+			all += total[i];
+		}
+	}
+	if (all == 0) {
+		goto out;
+	}
+
+	printf("CPU groups (window of %d slots)\n", SCHED_GROUP_WINDOW);
+	printf("\t%-16s %8s %10s %8s %7s\n", "group", "shares", "processes",
+		"slots", "usage");
+	for (i = 0; i < nr_groups; i++) {
+		if (groups[i].nr_loaded > 0) {
+			printf("\t%-16s %8u %10d %8lu %6.1f%%\n", groups[i].name,
+				groups[i].shares, groups[i].nr_loaded,
+				total[i], 100.0 * total[i] / all);
+		}
+	}
+
+	printf("\t%6s", "slot");
+	for (i = 0; i < nr_groups; i++) {
+		if (groups[i].nr_loaded > 0) {
+			printf(" %14.14s", groups[i].name);
+		}
+	}
+	printf("\n");
+	for (window = 0; window < nr_windows; window++) {
+		unsigned long used = 0;
+		for (i = 0; i < nr_groups; i++) {
+			used += group_slots(window, i);
+		}
+		if (used == 0) {
+			continue;
+		}
+		printf("\t%6d", window * SCHED_GROUP_WINDOW);
+		for (i = 0; i < nr_groups; i++) {
+			if (groups[i].nr_loaded > 0) {
+				printf(" %8lu %4.0f%%", group_slots(window, i),
+					100.0 * group_slots(window, i) / used);
+			}
+		}
+		printf("\n");
+	}
+out:
+	for (cpu = 0; cpu < group_nr_cpus; cpu++) {
+		free(group_usage[cpu].slots);
+	}
+	free(group_usage);
+}
@@ -0,0 +1,219 @@
+/*
+ * Multi-level feedback queue policy
+ * sched/sched-mlfq.c
+ *
+ * The [prio] of the config is ignored: every process enters the top of
+ * MLFQ_LEVELS levels and the scheduler learns how it behaves. Level l
+ * runs for MLFQ_QUANTUM << l time slots. A process that used up the whole
+ * quantum of its level, possibly over several dispatches, is demoted one
+ * level; one that is preempted earlier keeps its level and what is left of
+ * its allotment. Every MLFQ_BOOST_PERIOD time slots all processes go back
+ * to the top level, so demoted ones cannot starve. Selected with
+ * --sched=mlfq.
+ */
+
+#include "queue.h"
+#include "sched.h"
+#include "timer.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+struct mlfq_rq {
+	struct sched_lock lock;
+	struct queue_t levels[MLFQ_LEVELS];
+	unsigned long bitmap;	// Bit l is set iff levels[l] is not empty
+	uint64_t epoch;		// Boost period the levels were last reset in
+	int nr_queued;		// Processes in [levels], read without lock
+};
+
+static struct mlfq_rq * mlfq_rqs;
+static int mlfq_nr_cpus;
+static unsigned long nr_demotions = 0;	// Atomic
+static unsigned long nr_boosts = 0;	// Atomic
+
+static uint64_t mlfq_epoch(void) {
+	return current_time() / MLFQ_BOOST_PERIOD;
+}
+
+static struct pcb_t * mlfq_dequeue(struct mlfq_rq * rq) {
+	if (rq->bitmap == 0) {
+		return NULL;
+	}
+	int level = __builtin_ctzl(rq->bitmap);
+	struct pcb_t * proc = dequeue(&rq->levels[level]);
+	if (empty(&rq->levels[level])) {
+		rq->bitmap &= ~(1UL << level);
+	}
+	__atomic_sub_fetch(&rq->nr_queued, 1, __ATOMIC_RELAXED);
+	return proc;
+}
+
+/* Lift every process of [rq] to the top level once per boost period,
+ * [rq] must be locked */
+static void mlfq_boost(struct mlfq_rq * rq) {
+	uint64_t epoch = mlfq_epoch();
+	int level;
+	if (rq->epoch == epoch) {
+		return;
+	}
+	rq->epoch = epoch;
+	if (rq->bitmap & ~1UL) {
+		__atomic_add_fetch(&nr_boosts, 1, __ATOMIC_RELAXED);
+	}
+	/* Levels are moved top down so that each keeps its FIFO order */
+	for (level = 0; level < MLFQ_LEVELS; level++) {
+		struct queue_t * q = &rq->levels[level];
+		int n = q->size;
+		while (n-- > 0) {
+			struct pcb_t * proc = level ? dequeue(q) : q->heap[n].proc;
+			proc->mlfq_epoch = epoch;
+			proc->mlfq_level = 0;
+			proc->mlfq_used = 0;
+			if (level > 0) {
+				enqueue_key(&rq->levels[0], proc, 0);
+			}
+		}
+	}
+	rq->bitmap = empty(&rq->levels[0]) ? 0 : 1UL;
+}
+
+/* [rq] must be locked */
+static void mlfq_enqueue(struct mlfq_rq * rq, struct pcb_t * proc) {
+	mlfq_boost(rq);
+	/* A process that missed a boost while running starts over */
+	if (proc->mlfq_epoch != rq->epoch) {
+		proc->mlfq_epoch = rq->epoch;
+		proc->mlfq_level = 0;
+		proc->mlfq_used = 0;
+	}
+	enqueue_key(&rq->levels[proc->mlfq_level], proc, 0);
+	rq->bitmap |= 1UL << proc->mlfq_level;
+	__atomic_add_fetch(&rq->nr_queued, 1, __ATOMIC_RELAXED);
+}
+
+static int mlfq_nr_queued(int cpu) {
+	return __atomic_load_n(&mlfq_rqs[cpu].nr_queued, __ATOMIC_RELAXED);
+}
+
+static void init_mlfq_scheduler(int num_cpus) {
+	int cpu;
+	mlfq_nr_cpus = num_cpus;
+	mlfq_rqs = (struct mlfq_rq*)calloc(num_cpus, sizeof(struct mlfq_rq));
+	for (cpu = 0; cpu < num_cpus; cpu++) {
+		sched_lock_init(&mlfq_rqs[cpu].lock);
+	}
+}
+
+static int mlfq_queue_empty(void) {
+	int cpu;
+	for (cpu = 0; cpu < mlfq_nr_cpus; cpu++) {
+		if (mlfq_nr_queued(cpu) > 0) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static struct pcb_t * get_mlfq_proc(int cpu) {
+	struct mlfq_rq * rq = &mlfq_rqs[cpu];
+	struct pcb_t * proc;
+
+	sched_lock(&rq->lock, cpu);
+	mlfq_boost(rq);
+	proc = mlfq_dequeue(rq);
+	sched_unlock(&rq->lock, cpu);
+	if (proc != NULL) {
+		return proc;
+	}
+
+	/* Nothing left locally, take the most urgent process of the
+	 * busiest peer */
+	int victim = -1;
+	int most = 0;
+	int i;
+	for (i = 0; i < mlfq_nr_cpus; i++) {
+		int nr = mlfq_nr_queued(i);
+		if (i != cpu && nr > most) {
+			victim = i;
+			most = nr;
+		}
+	}
+	if (victim < 0) {
+		return NULL;
+	}
+
+	struct mlfq_rq * src = &mlfq_rqs[victim];
+	sched_lock(&src->lock, cpu);
+	mlfq_boost(src);
+	proc = mlfq_dequeue(src);
+	sched_unlock(&src->lock, cpu);
+	if (proc != NULL) {
+		sched_count_steal(cpu);
+	}
+	return proc;
+}
+
+static int mlfq_quantum(int cpu, struct pcb_t * proc) {
+	return (MLFQ_QUANTUM << proc->mlfq_level) - proc->mlfq_used;
+}
+
+static void mlfq_tick(int cpu, struct pcb_t * proc) {
+	proc->mlfq_used++;
+}
+
+static void put_mlfq_proc(int cpu, struct pcb_t * proc) {
+	struct mlfq_rq * rq = &mlfq_rqs[cpu];
+	/* Used up the whole allotment of its level: demote */
+	if (proc->mlfq_used >= MLFQ_QUANTUM << proc->mlfq_level) {
+		if (proc->mlfq_level < MLFQ_LEVELS - 1) {
+			proc->mlfq_level++;
+			__atomic_add_fetch(&nr_demotions, 1, __ATOMIC_RELAXED);
+		}
+		proc->mlfq_used = 0;
+	}
+	sched_lock(&rq->lock, cpu);
+	mlfq_enqueue(rq, proc);
+	sched_unlock(&rq->lock, cpu);
+}
+
+static void prepare_mlfq_proc(struct pcb_t * proc) {
+	proc->mlfq_level = 0;
+	proc->mlfq_used = 0;
+	proc->mlfq_epoch = mlfq_epoch();
+}
+
+static void add_mlfq_proc(struct pcb_t * proc) {
+	/* New processes go to the top level of the least loaded CPU */
+	int cpu = 0;
+	int i;
+	for (i = 1; i < mlfq_nr_cpus; i++) {
+		if (mlfq_nr_queued(i) < mlfq_nr_queued(cpu)) {
+			cpu = i;
+		}
+	}
+
+	struct mlfq_rq * rq = &mlfq_rqs[cpu];
+	sched_lock(&rq->lock, -1);
+	mlfq_enqueue(rq, proc);
+	sched_unlock(&rq->lock, -1);
+}
+
+static void mlfq_report(void) {
+	printf("\tmlfq demotions: %lu, boosts: %lu\n",
+		__atomic_load_n(&nr_demotions, __ATOMIC_RELAXED),
+		__atomic_load_n(&nr_boosts, __ATOMIC_RELAXED));
+}
+
+const struct sched_class mlfq_sched_class = {
+	.name = "mlfq",
+	.init = init_mlfq_scheduler,
+	.get = get_mlfq_proc,
+	.put = put_mlfq_proc,
+	.add = add_mlfq_proc,
+	.empty = mlfq_queue_empty,
+	.quantum = mlfq_quantum,
+	.tick = mlfq_tick,
+	.prepare = prepare_mlfq_proc,
+	.report = mlfq_report,
+};
+
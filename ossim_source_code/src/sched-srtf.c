@@ -0,0 +1,75 @@
+/*
+ * Shortest-remaining-time-first policy
+ * sched/sched-srtf.c
+ *
+ * The remaining work of a process, code->size - pc, is known exactly. All
+ * runnable processes wait in one heap ordered by it, and every time slot
+ * of the config the CPU goes back to the shortest one. With --preempt a
+ * newcomer shorter than a running process takes its CPU right away.
+ *
+ * With SRTF_AGING > 0 a process earns one instruction of credit for every
+ * SRTF_AGING slots it waits, so long jobs are not starved. The credit
+ * grows at the same rate for every waiting process, hence comparing
+ * remaining * SRTF_AGING + enqueue slot orders them the same way at any
+ * later time and the heap key never has to be updated.
+ */
+
+#include "queue.h"
+#include "sched.h"
+#include "timer.h"
+#include <stdlib.h>
+
+static struct queue_t srtf_queue;
+static struct sched_lock srtf_lock;
+
+static uint32_t srtf_remaining(struct pcb_t * proc) {
+	return proc->code->size - proc->pc;
+}
+
+static uint64_t srtf_key(struct pcb_t * proc) {
+#if SRTF_AGING > 0
+	return (uint64_t)srtf_remaining(proc) * SRTF_AGING + current_time();
+#else
+	return srtf_remaining(proc);
+#endif
+}
+
+static void init_srtf_scheduler(int num_cpus) {
+	srtf_queue.size = 0;
+	sched_lock_init(&srtf_lock);
+}
+
+static int srtf_queue_empty(void) {
+	return empty(&srtf_queue);
+}
+
+static struct pcb_t * get_srtf_proc(int cpu) {
+	struct pcb_t * proc;
+	sched_lock(&srtf_lock, cpu);
+	proc = dequeue(&srtf_queue);
+	sched_unlock(&srtf_lock, cpu);
+	return proc;
+}
+
+static void put_srtf_proc(int cpu, struct pcb_t * proc) {
+	sched_lock(&srtf_lock, cpu);
+	enqueue_key(&srtf_queue, proc, srtf_key(proc));
+	sched_unlock(&srtf_lock, cpu);
+}
+
+static void add_srtf_proc(struct pcb_t * proc) {
+	sched_lock(&srtf_lock, -1);
+	enqueue_key(&srtf_queue, proc, srtf_key(proc));
+	sched_unlock(&srtf_lock, -1);
+}
+
+const struct sched_class srtf_sched_class = {
+	.name = "srtf",
+	.init = init_srtf_scheduler,
+	.get = get_srtf_proc,
+	.put = put_srtf_proc,
+	.add = add_srtf_proc,
+	.empty = srtf_queue_empty,
+	.rank = srtf_remaining,
+};
+
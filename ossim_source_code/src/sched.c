@@ -1,130 +1,773 @@
-
 #include "queue.h"
 #include "sched.h"
+#include "bitops.h"
+#include "timer.h"
 #include <pthread.h>
 
 #include <stdlib.h>
 #include <stdio.h>
-static struct queue_t ready_queue;
-static struct queue_t run_queue;
-static pthread_mutex_t queue_lock;
+#include <string.h>
+#include <limits.h>
+
+static const struct sched_class * const sched_classes[] = {
+	&fifo_sched_class,
+	&rr_sched_class,
+	&mlq_sched_class,
+	&cfs_sched_class,
+	&mlfq_sched_class,
+	&srtf_sched_class,
+};
+
+static const struct sched_class * sched_class = &mlq_sched_class;
+static int sched_nr_cpus;
+static int sched_time_slot = 1;
+
+/*
+ * Preemption on arrival
+ *
+ * running_rank[cpu] is the rank (by default the [prio]) of the process CPU
+ * [cpu] runs, RANK_IDLE if none, and is read by add_proc() without any
+ * lock. A new process that beats the worst running one is parked in
+ * handoff[] of that CPU, which yields at its next slot boundary and runs
+ * the newcomer next.
+ */
+#define RANK_IDLE UINT32_MAX
 
-#ifdef MLQ_SCHED
-	struct queue_t mlq_ready_queue[MAX_PRIO];
-	uint32_t currentPrior;
+static int sched_preempt = 0;
+static uint32_t * running_rank;
+static struct pcb_t ** handoff;
+static unsigned long nr_preempts = 0;	// Only the loader adds processes
+
+#ifdef SCHED_STATS
+/* One row per CPU, the last one is the loader */
+struct sched_stats {
+	unsigned long nr_locks;
+	unsigned long lock_ns;
+	unsigned long max_lock_ns;
+	unsigned long nr_steals;	// Processes this CPU took from others
+};
+
+static struct sched_stats * sched_stats;
+static int sched_lock_times = 0;
+
+static struct sched_stats * stats_of(int cpu) {
+	return &sched_stats[cpu < 0 ? sched_nr_cpus : cpu];
+}
 #endif
 
-int queue_empty(void) {
-#ifdef MLQ_SCHED
-	unsigned long prio;
-	for (prio = 0; prio < MAX_PRIO; prio++)
-		if(!empty(&mlq_ready_queue[prio])) 
-			return -1;
+int set_scheduler(const char * name) {
+	int i;
+	for (i = 0; i < sizeof(sched_classes) / sizeof(sched_classes[0]); i++) {
+		if (!strcmp(sched_classes[i]->name, name)) {
+			sched_class = sched_classes[i];
+			return 0;
+		}
+	}
+	return -1;
+}
+
+const char * scheduler_name(void) {
+	return sched_class->name;
+}
+
+void sched_lock_init(struct sched_lock * lock) {
+	pthread_mutex_init(&lock->mutex, NULL);
+}
+
+void sched_lock(struct sched_lock * lock, int cpu) {
+	pthread_mutex_lock(&lock->mutex);
+#ifdef SCHED_STATS
+	if (sched_lock_times) {
+		clock_gettime(CLOCK_MONOTONIC, &lock->start);
+	}
 #endif
-	return (empty(&ready_queue) && empty(&run_queue));
 }
 
-void init_scheduler(void) {
-#ifdef MLQ_SCHED
-	currentPrior = 0;
-    int i ;
-	for (i = 0; i < MAX_PRIO; i ++) {
-		mlq_ready_queue[i].size = 0;
-		mlq_ready_queue[i].slot = MAX_PRIO - i;
+void sched_unlock(struct sched_lock * lock, int cpu) {
+#ifdef SCHED_STATS
+	struct sched_stats * stats = stats_of(cpu);
+	stats->nr_locks++;
+	if (sched_lock_times) {
+		struct timespec now;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		unsigned long ns = (now.tv_sec - lock->start.tv_sec)
+			* 1000000000UL + now.tv_nsec - lock->start.tv_nsec;
+		stats->lock_ns += ns;
+		if (ns > stats->max_lock_ns) {
+			stats->max_lock_ns = ns;
+		}
 	}
+#endif
+	pthread_mutex_unlock(&lock->mutex);
+}
 
+void sched_set_lock_times(int on) {
+#ifdef SCHED_STATS
+	sched_lock_times = on;
 #endif
-	ready_queue.size = 0;
-	run_queue.size = 0;
-	pthread_mutex_init(&queue_lock, NULL);
 }
 
-#ifdef MLQ_SCHED
-/* 
- *  Stateful design for routine calling
- *  based on the priority and our MLQ policy
- *  We implement stateful here using transition technique
- *  State representation   prio = 0 .. MAX_PRIO, curr_slot = 0..(MAX_PRIO - prio)
+void sched_set_preempt(int on) {
+	sched_preempt = on;
+}
+
+void sched_set_time_slot(int slot) {
+	sched_time_slot = slot;
+}
+
+int sched_need_resched(int cpu) {
+	return sched_preempt
+		&& __atomic_load_n(&handoff[cpu], __ATOMIC_RELAXED) != NULL;
+}
+
+/* Real-time processes outrank everything but each other */
+static uint32_t sched_rank(struct pcb_t * proc) {
+	if (proc->deadline) {
+		return 0;
+	}
+	return sched_class->rank ? sched_class->rank(proc) : proc->prio;
+}
+
+/* Hand [proc] over to the CPU running the least urgent process, if that
+ * one is less urgent than [proc]. Return 0 if nobody was preempted */
+static int preempt_for(struct pcb_t * proc) {
+	uint32_t rank = sched_rank(proc);
+	uint32_t worst = rank;
+	int target = -1;
+	int cpu;
+	for (cpu = 0; cpu < sched_nr_cpus; cpu++) {
+		uint32_t prio = __atomic_load_n(&running_rank[cpu],
+				__ATOMIC_RELAXED);
+		if (prio > worst) {
+			worst = prio;
+			target = cpu;
+		}
+	}
+	if (target < 0) {
+		return 0;
+	}
+
+	struct pcb_t * none = NULL;
+	if (!__atomic_compare_exchange_n(&handoff[target], &none, proc, 0,
+			__ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+		return 0;
+	}
+	/* Later arrivals of this slot look for another victim */
+	__atomic_store_n(&running_rank[target], rank, __ATOMIC_RELAXED);
+	if (worst != RANK_IDLE) {
+		nr_preempts++;
+	}
+	return 1;
+}
+
+void sched_count_steal(int cpu) {
+#ifdef SCHED_STATS
+	stats_of(cpu)->nr_steals++;
+#endif
+}
+
+int sched_cache_hot(struct pcb_t * proc, int cpu) {
+	return proc->last_cpu == cpu
+		&& current_time() - proc->last_run <= CACHE_HOT_SLOTS;
+}
+
+/* [proc] is not hot in the cache of another CPU than [cpu], so running
+ * it on [cpu] costs no more than running it anywhere else */
+static int cache_affine(struct pcb_t * proc, int cpu) {
+	return proc->last_cpu < 0 || proc->last_cpu == cpu
+		|| !sched_cache_hot(proc, proc->last_cpu);
+}
+
+/* Dequeue the head of [q] for CPU [cpu], or the first process right
+ * behind it with the same key if the head is still hot on another CPU */
+static struct pcb_t * dequeue_affine(struct queue_t * q, int cpu) {
+	struct pcb_t * proc = queue_find(q, CACHE_AFFINITY_SCAN,
+			cache_affine, cpu);
+	if (proc == NULL) {
+		return dequeue(q);
+	}
+	queue_remove(q, proc);
+	return proc;
+}
+
+int queue_empty(void) {
+	int cpu;
+	for (cpu = 0; sched_preempt && cpu < sched_nr_cpus; cpu++) {
+		if (__atomic_load_n(&handoff[cpu], __ATOMIC_RELAXED) != NULL) {
+			return 0;
+		}
+	}
+	return edf_sched_class.empty() && sched_class->empty();
+}
+
+void init_scheduler(int num_cpus) {
+	int cpu;
+	sched_nr_cpus = num_cpus;
+#ifdef SCHED_STATS
+	sched_stats = (struct sched_stats*)calloc(num_cpus + 1,
+			sizeof(struct sched_stats));
+#endif
+	running_rank = (uint32_t*)malloc(num_cpus * sizeof(uint32_t));
+	handoff = (struct pcb_t**)calloc(num_cpus, sizeof(struct pcb_t*));
+	for (cpu = 0; cpu < num_cpus; cpu++) {
+		running_rank[cpu] = RANK_IDLE;
+	}
+	init_groups(num_cpus);
+	edf_sched_class.init(num_cpus);
+	sched_class->init(num_cpus);
+}
+
+void finish_scheduler(void) {
+#ifdef SCHED_STATS
+	int cpu;
+	unsigned long steals = 0, locks = 0, lock_ns = 0;
+	printf("Scheduler statistics (%s)\n", sched_class->name);
+	printf("\t%3s %8s %10s", "CPU", "steals", "locks");
+	if (sched_lock_times) {
+		printf(" %14s %14s", "avg hold(ns)", "max hold(ns)");
+	}
+	printf("\n");
+	for (cpu = 0; cpu <= sched_nr_cpus; cpu++) {
+		struct sched_stats * stats = &sched_stats[cpu];
+		if (cpu < sched_nr_cpus) {
+			printf("\t%3d", cpu);
+		} else {
+			printf("\t%3s", "ld");
+		}
+		printf(" %8lu %10lu", stats->nr_steals, stats->nr_locks);
+		if (sched_lock_times) {
+			printf(" %14lu %14lu", stats->nr_locks ?
+				stats->lock_ns / stats->nr_locks : 0,
+				stats->max_lock_ns);
+		}
+		printf("\n");
+		steals += stats->nr_steals;
+		locks += stats->nr_locks;
+		lock_ns += stats->lock_ns;
+	}
+	printf("\t%3s %8lu %10lu", "all", steals, locks);
+	if (sched_lock_times) {
+		printf(" %14lu", locks ? lock_ns / locks : 0);
+	}
+	printf("\n");
+	printf("\tdropped processes: %lu\n", queue_dropped());
+	if (sched_preempt) {
+		printf("\tpreemptions: %lu\n", nr_preempts);
+	}
+	if (sched_class->report != NULL) {
+		sched_class->report();
+	}
+	edf_sched_class.report();
+	free(sched_stats);
+#endif
+	report_groups();
+	free(running_rank);
+	free(handoff);
+}
+
+struct pcb_t * get_proc(int cpu) {
+	struct pcb_t * proc = NULL;
+	if (!sched_preempt) {
+		proc = edf_sched_class.get(cpu);
+		return proc ? proc : sched_class->get(cpu);
+	}
+
+	proc = __atomic_exchange_n(&handoff[cpu], NULL, __ATOMIC_ACQUIRE);
+	if (proc == NULL) {
+		proc = edf_sched_class.get(cpu);
+	}
+	if (proc == NULL) {
+		proc = sched_class->get(cpu);
+	}
+	__atomic_store_n(&running_rank[cpu],
+			proc ? sched_rank(proc) : RANK_IDLE, __ATOMIC_RELAXED);
+	return proc;
+}
+
+void put_proc(int cpu, struct pcb_t * proc) {
+	if (proc->deadline) {
+		edf_sched_class.put(cpu, proc);
+	} else {
+		sched_class->put(cpu, proc);
+	}
+}
+
+void add_proc(struct pcb_t * proc) {
+	if (sched_class->prepare != NULL) {
+		sched_class->prepare(proc);
+	}
+	group_enter(proc);
+	if (sched_preempt && preempt_for(proc)) {
+		return;
+	}
+	if (proc->deadline) {
+		edf_sched_class.add(proc);
+	} else {
+		sched_class->add(proc);
+	}
+}
+
+void sched_exit(int cpu, struct pcb_t * proc) {
+	group_exit(proc);
+	if (proc->deadline) {
+		edf_finish(cpu, proc);
+	}
+}
+
+int sched_quantum(int cpu, struct pcb_t * proc) {
+	/* Real-time processes are not sliced, they run to completion
+	 * unless one with an earlier deadline preempts them */
+	if (proc->deadline) {
+		return proc->code->size - proc->pc;
+	}
+	if (sched_class->quantum == NULL) {
+		return 0;
+	}
+	return sched_class->quantum(cpu, proc);
+}
+
+void sched_tick(int cpu, struct pcb_t * proc, int refill) {
+	group_charge(cpu, proc);
+	if (proc->deadline || refill) {
+		return;
+	}
+	if (sched_class->tick != NULL) {
+		sched_class->tick(cpu, proc);
+	}
+	/* Ranks that change while running are kept up to date */
+	if (sched_preempt && sched_class->rank != NULL) {
+		__atomic_store_n(&running_rank[cpu], sched_class->rank(proc),
+				__ATOMIC_RELAXED);
+	}
+}
+
+/*
+ * FIFO and round-robin: one global ready queue in arrival order. FIFO
+ * runs every process to completion, round-robin preempts it after the
+ * time slot of the config.
  */
+static struct queue_t ready_queue;
+static struct sched_lock queue_lock;
+
+static void init_fifo(int num_cpus) {
+	ready_queue.size = 0;
+	sched_lock_init(&queue_lock);
+}
+
+static int fifo_empty(void) {
+	return empty(&ready_queue);
+}
 
-struct pcb_t * get_mlq_proc(void) {
-	static int currentPrio = 0;
+static struct pcb_t * get_fifo_proc(int cpu) {
 	struct pcb_t * proc = NULL;
-	/*TODO: get a process from PRIORITY [ready_queue].
+	/*TODO: get a process from [ready_queue].
 	 * Remember to use lock to protect the queue.
 	 * */
-	pthread_mutex_lock(&queue_lock);
-	int slot = MAX_PRIO - currentPrio;
+	sched_lock(&queue_lock, cpu);
+	proc = dequeue_affine(&ready_queue, cpu);
+	sched_unlock(&queue_lock, cpu);
+	return proc;
+}
+
+static void put_fifo_proc(int cpu, struct pcb_t * proc) {
+	sched_lock(&queue_lock, cpu);
+	enqueue_key(&ready_queue, proc, 0);
+	sched_unlock(&queue_lock, cpu);
+}
+
+static void add_fifo_proc(struct pcb_t * proc) {
+	sched_lock(&queue_lock, -1);
+	enqueue_key(&ready_queue, proc, 0);
+	sched_unlock(&queue_lock, -1);
+}
+
+static int fifo_quantum(int cpu, struct pcb_t * proc) {
+	return INT_MAX;
+}
+
+const struct sched_class fifo_sched_class = {
+	.name = "fifo",
+	.init = init_fifo,
+	.get = get_fifo_proc,
+	.put = put_fifo_proc,
+	.add = add_fifo_proc,
+	.empty = fifo_empty,
+	.quantum = fifo_quantum,
+};
 
-    // Duyệt qua các hàng đợi 
-    for (int attempt = 0; attempt < MAX_PRIO; attempt++) {
-        int prio = (currentPrio + attempt) % MAX_PRIO;
-        
-        if (!empty(&mlq_ready_queue[prio])) {
-            // Điều chỉnh slot giảm đi số mức ưu tiên bị bỏ qua
-            slot -= attempt;
-            if (slot > 0) {
-                proc = dequeue(&mlq_ready_queue[prio]);
-                slot--;
-                break;
-            } else {
-                currentPrio = (prio + 1) % MAX_PRIO;
-                slot = MAX_PRIO - currentPrio;
-                break;
-            }
-        }
-    }
+const struct sched_class rr_sched_class = {
+	.name = "rr",
+	.init = init_fifo,
+	.get = get_fifo_proc,
+	.put = put_fifo_proc,
+	.add = add_fifo_proc,
+	.empty = fifo_empty,
+};
 
-    pthread_mutex_unlock(&queue_lock);
-    return proc;
+#define MLQ_BITMAP_LONGS DIV_ROUND_UP(MAX_PRIO, BITS_PER_LONG)
+
+/*
+ * Per-CPU MLQ run queue
+ *
+ * Every simulated CPU owns one set of MAX_PRIO ready queues, protected by
+ * its own lock, so CPUs only contend when one of them steals work from
+ * another one. put_proc() and add_proc() never take that lock: they push
+ * the process on a lock-free inbox (a Treiber stack linked through
+ * pcb_t.rq_next) which the lock holder drains, in arrival order, before
+ * picking anything. Each fair-share group (sched-group.c) has its own set
+ * of levels, the group is picked first.
+ */
+struct mlq_levels {
+	struct queue_t ready_queue[MAX_PRIO];
+	/* Bit [prio] is set iff ready_queue[prio] is not empty */
+	unsigned long bitmap[MLQ_BITMAP_LONGS];
+	int cur_prio;		// Round-robin cursor over the levels
+	int nr_queued;
+	struct pcb_t * oldest;	// Waiters in queueing order
+	struct pcb_t * newest;
+};
+
+struct mlq_rq {
+	struct sched_lock lock;
+	struct mlq_levels * groups;	// Indexed by pcb_t.group
+	struct pcb_t * inbox;	// Pushed without lock, newest first
+	int nr_queued;		// Processes in inbox and levels, atomic
+	/* Waits of the processes dispatched from here, per [prio] */
+	unsigned long wait_hist[MAX_PRIO][MLQ_WAIT_BUCKETS];
+	/* Adaptive quantum shift per [prio], only used by the owner CPU */
+	unsigned char stretch[MAX_PRIO];
+};
+
+static struct mlq_rq * mlq_rqs;
+static int mlq_nr_cpus;
+static int mlq_nr_groups;
+static int mlq_quanta[MAX_PRIO];	// Base quantum per [prio]
+static unsigned long nr_aged = 0;	// Dispatched ahead by aging, atomic
+
+/* First non-empty level in [from, MAX_PRIO), MAX_PRIO if there is none */
+static int mlq_find_next(struct mlq_levels * levels, int from) {
+	if (from >= MAX_PRIO) {
+		return MAX_PRIO;
+	}
+	int word = BIT_WORD(from);
+	unsigned long bits = levels->bitmap[word]
+		& (~0UL << (from % BITS_PER_LONG));
+	while (bits == 0) {
+		if (++word == MLQ_BITMAP_LONGS) {
+			return MAX_PRIO;
+		}
+		bits = levels->bitmap[word];
+	}
+	return word * BITS_PER_LONG + __builtin_ctzl(bits);
 }
 
-void put_mlq_proc(struct pcb_t * proc) {
-	pthread_mutex_lock(&queue_lock);
-	enqueue(&mlq_ready_queue[proc->prio], proc);
-	pthread_mutex_unlock(&queue_lock);
+static void mlq_enqueue(struct mlq_rq * rq, struct pcb_t * proc) {
+	struct mlq_levels * levels = &rq->groups[proc->group];
+	enqueue(&levels->ready_queue[proc->prio], proc);
+	levels->bitmap[BIT_WORD(proc->prio)] |= BIT_MASK(proc->prio);
+	levels->nr_queued++;
+	proc->wait_next = NULL;
+	proc->wait_prev = levels->newest;
+	if (levels->newest != NULL) {
+		levels->newest->wait_next = proc;
+	} else {
+		levels->oldest = proc;
+	}
+	levels->newest = proc;
 }
 
-void add_mlq_proc(struct pcb_t * proc) {
-	pthread_mutex_lock(&queue_lock);
-	enqueue(&mlq_ready_queue[proc->prio], proc);
-	pthread_mutex_unlock(&queue_lock);	
+/* Bookkeeping of [proc] leaving level [prio] of [levels] */
+static struct pcb_t * mlq_taken(struct mlq_rq * rq,
+		struct mlq_levels * levels, int prio, struct pcb_t * proc) {
+	if (empty(&levels->ready_queue[prio])) {
+		levels->bitmap[BIT_WORD(prio)] &= ~BIT_MASK(prio);
+	}
+	levels->nr_queued--;
+	__atomic_sub_fetch(&rq->nr_queued, 1, __ATOMIC_RELAXED);
+	if (proc->wait_prev != NULL) {
+		proc->wait_prev->wait_next = proc->wait_next;
+	} else {
+		levels->oldest = proc->wait_next;
+	}
+	if (proc->wait_next != NULL) {
+		proc->wait_next->wait_prev = proc->wait_prev;
+	} else {
+		levels->newest = proc->wait_prev;
+	}
+
+	uint64_t wait = current_time() - proc->wait_since;
+	int bucket = wait ? 64 - __builtin_clzl(wait) : 0;
+	if (bucket >= MLQ_WAIT_BUCKETS) {
+		bucket = MLQ_WAIT_BUCKETS - 1;
+	}
+	rq->wait_hist[prio][bucket]++;
+	return proc;
 }
 
-struct pcb_t * get_proc(void) {
-	return get_mlq_proc();
+/* Dequeue the next process of level [prio] of [levels] for CPU [cpu],
+ * unless the oldest waiter has aged past that level: it then goes first.
+ * Its effective priority is its [prio] less MAX_PRIO / MLQ_AGING levels
+ * per slot it has waited. Only the oldest waiter is checked, so aging
+ * costs O(1) per dispatch and still bounds the wait of every process */
+static struct pcb_t * mlq_dequeue(struct mlq_rq * rq,
+		struct mlq_levels * levels, int prio, int cpu) {
+	struct pcb_t * proc;
+#if MLQ_AGING > 0
+	proc = levels->oldest;
+	if (proc->prio > prio && (proc->prio - prio) * MLQ_AGING
+			<= (current_time() - proc->wait_since) * MAX_PRIO) {
+		queue_remove(&levels->ready_queue[proc->prio], proc);
+		__atomic_add_fetch(&nr_aged, 1, __ATOMIC_RELAXED);
+		return mlq_taken(rq, levels, proc->prio, proc);
+	}
+#endif
+	proc = dequeue_affine(&levels->ready_queue[prio], cpu);
+	return mlq_taken(rq, levels, prio, proc);
 }
 
-void put_proc(struct pcb_t * proc) {
-	return put_mlq_proc(proc);
+/* Levels of the waiting group that used the least of its share, NULL if
+ * no group is waiting. [rq] must be locked */
+static struct mlq_levels * mlq_pick_group(struct mlq_rq * rq) {
+	struct mlq_levels * levels = NULL;
+	uint64_t least = 0;
+	int i;
+	for (i = 0; i < mlq_nr_groups; i++) {
+		if (rq->groups[i].nr_queued == 0) {
+			continue;
+		}
+		uint64_t vtime = group_vtime(i);
+		if (levels == NULL || vtime < least) {
+			levels = &rq->groups[i];
+			least = vtime;
+		}
+	}
+	return levels;
 }
 
-void add_proc(struct pcb_t * proc) {
-	return add_mlq_proc(proc);
+/* Lock-free: publish [proc] to the inbox of [rq] */
+static void mlq_push(struct mlq_rq * rq, struct pcb_t * proc) {
+	proc->wait_since = current_time();
+	struct pcb_t * head = __atomic_load_n(&rq->inbox, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&rq->nr_queued, 1, __ATOMIC_RELAXED);
+	do {
+		proc->rq_next = head;
+	} while (!__atomic_compare_exchange_n(&rq->inbox, &head, proc, 1,
+			__ATOMIC_RELEASE, __ATOMIC_RELAXED));
 }
-#else
-struct pcb_t * get_proc(void) {
+
+/* Move every process of the inbox to its level, [rq] must be locked */
+static void mlq_drain(struct mlq_rq * rq) {
+	struct pcb_t * list = __atomic_exchange_n(&rq->inbox, NULL,
+			__ATOMIC_ACQUIRE);
+	struct pcb_t * fifo = NULL;
+	/* The inbox is a stack, reverse it to keep arrival order */
+	while (list != NULL) {
+		struct pcb_t * next = list->rq_next;
+		list->rq_next = fifo;
+		fifo = list;
+		list = next;
+	}
+	while (fifo != NULL) {
+		struct pcb_t * next = fifo->rq_next;
+		mlq_enqueue(rq, fifo);
+		fifo = next;
+	}
+}
+
+static int mlq_nr_queued(int cpu) {
+	return __atomic_load_n(&mlq_rqs[cpu].nr_queued, __ATOMIC_RELAXED);
+}
+
+static void init_mlq(int num_cpus) {
+	int cpu, g, i;
+	mlq_nr_cpus = num_cpus;
+	mlq_nr_groups = sched_nr_groups();
+	for (i = 0; i < MAX_PRIO; i++) {
+		mlq_quanta[i] = sched_time_slot + sched_time_slot
+			* (MLQ_QUANTUM_SCALE - 1) * i / (MAX_PRIO - 1);
+	}
+	mlq_rqs = (struct mlq_rq*)calloc(num_cpus, sizeof(struct mlq_rq));
+	for (cpu = 0; cpu < num_cpus; cpu++) {
+		struct mlq_rq * rq = &mlq_rqs[cpu];
+		rq->groups = (struct mlq_levels*)calloc(mlq_nr_groups,
+				sizeof(struct mlq_levels));
+		for (g = 0; g < mlq_nr_groups; g++) {
+			for (i = 0; i < MAX_PRIO; i ++) {
+				rq->groups[g].ready_queue[i].size = 0;
+				rq->groups[g].ready_queue[i].slot = MAX_PRIO - i;
+			}
+		}
+		sched_lock_init(&rq->lock);
+	}
+}
+
+static int mlq_empty(void) {
+	int cpu;
+	for (cpu = 0; cpu < mlq_nr_cpus; cpu++) {
+		if (mlq_nr_queued(cpu) > 0) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/*
+ *  Stateful design for routine calling
+ *  based on the priority and our MLQ policy
+ *  We implement stateful here using transition technique
+ *  State representation   prio = 0 .. MAX_PRIO, curr_slot = 0..(MAX_PRIO - prio)
+ */
+
+static struct pcb_t * pick_mlq_proc(struct mlq_rq * rq, int cpu) {
 	struct pcb_t * proc = NULL;
-	/*TODO: get a process from [ready_queue].
+	struct mlq_levels * levels = mlq_pick_group(rq);
+	if (levels == NULL) {
+		return NULL;
+	}
+	/* Levels are visited round-robin from cur_prio. The slot budget
+	 * of the current level, MAX_PRIO - cur_prio, runs out exactly when
+	 * the search wraps around, then the cursor moves past the level found
+	 * and this round yields nothing */
+	int prio = mlq_find_next(levels, levels->cur_prio);
+	if (prio != MAX_PRIO) {
+		proc = mlq_dequeue(rq, levels, prio, cpu);
+	} else {
+		prio = mlq_find_next(levels, 0);
+		if (prio != MAX_PRIO) {
+			levels->cur_prio = (prio + 1) % MAX_PRIO;
+		}
+	}
+	return proc;
+}
+
+/* Take the most urgent process of the CPU with the longest run queue,
+ * preferably one whose cache there has gone cold already */
+static struct pcb_t * steal_mlq_proc(int cpu) {
+	struct pcb_t * proc = NULL;
+	int victim = -1;
+	int most = 0;
+	int i;
+	for (i = 0; i < mlq_nr_cpus; i++) {
+		int nr = mlq_nr_queued(i);
+		if (i != cpu && nr > most) {
+			victim = i;
+			most = nr;
+		}
+	}
+	if (victim < 0) {
+		return NULL;
+	}
+
+	struct mlq_rq * rq = &mlq_rqs[victim];
+	sched_lock(&rq->lock, cpu);
+	mlq_drain(rq);
+	struct mlq_levels * levels = mlq_pick_group(rq);
+	if (levels != NULL) {
+		proc = mlq_dequeue(rq, levels, mlq_find_next(levels, 0), cpu);
+	}
+	sched_unlock(&rq->lock, cpu);
+	if (proc != NULL) {
+		sched_count_steal(cpu);
+	}
+	return proc;
+}
+
+static struct pcb_t * get_mlq_proc(int cpu) {
+	struct mlq_rq * rq = &mlq_rqs[cpu];
+	struct pcb_t * proc = NULL;
+	int idle;
+	/*TODO: get a process from PRIORITY [ready_queue].
 	 * Remember to use lock to protect the queue.
 	 * */
-	pthread_mutex_lock(&queue_lock);
-	proc = dequeue(&ready_queue);
-	pthread_mutex_unlock(&queue_lock);
+	sched_lock(&rq->lock, cpu);
+	mlq_drain(rq);
+	proc = pick_mlq_proc(rq, cpu);
+	idle = (mlq_nr_queued(cpu) == 0);
+	sched_unlock(&rq->lock, cpu);
+
+	/* Nothing left locally, look for work on the busiest peer */
+	if (proc == NULL && idle) {
+		proc = steal_mlq_proc(cpu);
+	}
 	return proc;
 }
 
-void put_proc(struct pcb_t * proc) {
-	pthread_mutex_lock(&queue_lock);
-	enqueue(&run_queue, proc);
-	pthread_mutex_unlock(&queue_lock);
+static int mlq_quantum(int cpu, struct pcb_t * proc) {
+	return mlq_quanta[proc->prio] << mlq_rqs[cpu].stretch[proc->prio];
 }
 
-void add_proc(struct pcb_t * proc) {
-	pthread_mutex_lock(&queue_lock);
-	enqueue(&ready_queue, proc);
-	pthread_mutex_unlock(&queue_lock);	
-}
+static void put_mlq_proc(int cpu, struct pcb_t * proc) {
+	struct mlq_rq * rq = &mlq_rqs[cpu];
+#if MLQ_QUANTUM_ADAPT > 0
+	/* Used up its quantum rather than preempted: stretch the level
+	 * while the CPU would only switch back to it, not once somebody
+	 * else waits */
+	unsigned char * stretch = &rq->stretch[proc->prio];
+	if (!sched_need_resched(cpu)) {
+		if (mlq_nr_queued(cpu) > 0) {
+			*stretch = 0;
+		} else if (*stretch < MLQ_QUANTUM_ADAPT) {
+			(*stretch)++;
+		}
+	}
 #endif
+	mlq_push(rq, proc);
+}
+
+static void add_mlq_proc(struct pcb_t * proc) {
+	/* New processes go to the least loaded CPU */
+	int cpu = 0;
+	int i;
+	for (i = 1; i < mlq_nr_cpus; i++) {
+		if (mlq_nr_queued(i) < mlq_nr_queued(cpu)) {
+			cpu = i;
+		}
+	}
 
+	mlq_push(&mlq_rqs[cpu], proc);
+}
+
+/* Aged dispatches and the wait histogram of every level that was used,
+ * bucket b > 0 counts waits in [2^(b-1), 2^b) slots, the last one has no
+ * upper bound */
+static void mlq_report(void) {
+	unsigned long hist[MLQ_WAIT_BUCKETS];
+	int cpu, prio, b;
+	printf("\tmlq aged dispatches: %lu (aging %d)\n",
+		__atomic_load_n(&nr_aged, __ATOMIC_RELAXED), MLQ_AGING);
+	printf("\tmlq waits per level, buckets start at (slots)\n");
+	printf("\t%4s %7s", "prio", "n");
+	for (b = 0; b < MLQ_WAIT_BUCKETS; b++) {
+		printf(" %5lu", b ? 1UL << (b - 1) : 0);
+	}
+	printf("\n");
+	for (prio = 0; prio < MAX_PRIO; prio++) {
+		unsigned long n = 0;
+		for (b = 0; b < MLQ_WAIT_BUCKETS; b++) {
+			hist[b] = 0;
+			for (cpu = 0; cpu < mlq_nr_cpus; cpu++) {
+				hist[b] += mlq_rqs[cpu].wait_hist[prio][b];
+			}
+			n += hist[b];
+		}
+		if (n == 0) {
+			continue;
+		}
+		printf("\t%4d %7lu", prio, n);
+		for (b = 0; b < MLQ_WAIT_BUCKETS; b++) {
+			printf(" %5lu", hist[b]);
+		}
+		printf("\n");
+	}
+}
 
+const struct sched_class mlq_sched_class = {
+	.name = "mlq",
+	.init = init_mlq,
+	.get = get_mlq_proc,
+	.put = put_mlq_proc,
+	.add = add_mlq_proc,
+	.empty = mlq_empty,
+	.quantum = mlq_quantum,
+	.report = mlq_report,
+};
@@ -1,8 +1,16 @@
 
 #include "timer.h"
+#include "os-cfg.h"
 #include <stdio.h>
 #include <stdlib.h>
 
+#ifdef TIMER_SENSE_BARRIER
+#include <limits.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
 static pthread_t _timer;
 
 struct timer_id_container_t {
@@ -17,12 +25,225 @@ static uint64_t _time;
 static int timer_started = 0;
 static int timer_stop = 0;
 
+/* Every device is idle: print the empty slots and move the clock up to
+ * the one right before [wake] without a handshake per slot */
+static void fast_forward(uint64_t wake) {
+	if (wake == SLOT_NEVER) {
+		return;
+	}
+	while (_time + 1 < wake) {
+		_time++;
+		printf("Time slot %3lu\n", current_time());
+	}
+}
+
+#ifdef TIMER_SENSE_BARRIER
+/*
+ * Sense-reversing slot barrier
+ *
+ * Every attached device arrives by decrementing [nr_pending]; the last one
+ * wakes the timer. The timer then advances the clock, re-arms [nr_pending]
+ * with the number of still-attached devices and flips [slot_sense], which
+ * releases every device waiting on the old sense at once. Waiters spin for
+ * a short while before parking on a futex so that short slots never enter
+ * the kernel.
+ */
+static int nr_active = 0;	// Devices still attached to the timer
+static int nr_pending = 0;	// Devices not yet arrived in current slot
+static int slot_sense = 0;	// Flipped by the timer to release a slot
+static int nr_sleepers = 0;	// Devices parked on [slot_sense]
+static int barrier_spin = 0;	// No spinning on a single host core
+static int nr_idle = 0;		// Devices arrived idle in current slot
+static uint64_t next_wake = SLOT_NEVER;	// Earliest wake-up of idle devices
+static int nr_parked = 0;	// Devices parked or parking
+
+static void futex_wait(int * uaddr, int val) {
+	syscall(SYS_futex, uaddr, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+}
+
+static void futex_wake(int * uaddr, int nr) {
+	syscall(SYS_futex, uaddr, FUTEX_WAKE_PRIVATE, nr, NULL, NULL, 0);
+}
+
+/* Spin while [*uaddr] still equals [val]. Return 1 if it changed */
+static int spin_while(int * uaddr, int val) {
+	int spin;
+	for (spin = 0; spin < barrier_spin; spin++) {
+		if (__atomic_load_n(uaddr, __ATOMIC_ACQUIRE) != val) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* Mark one device as arrived, the last one wakes the timer up */
+static void slot_arrive(void) {
+	if (__atomic_sub_fetch(&nr_pending, 1, __ATOMIC_ACQ_REL) == 0) {
+		futex_wake(&nr_pending, 1);
+	}
+}
 
 static void * timer_routine(void * args) {
 	while (!timer_stop) {
-		printf("Time slot %3lu\n", current_time());
+		/* Wait for all devices have done the job in current
+		 * time slot */
+		int left;
+		while ((left = __atomic_load_n(&nr_pending, __ATOMIC_ACQUIRE)) != 0) {
+			if (!spin_while(&nr_pending, left)) {
+				futex_wait(&nr_pending, left);
+			}
+		}
+
+		/* Increase the time slot, jump straight to the next
+		 * wake-up when every attached device is idle */
+		int active = __atomic_load_n(&nr_active, __ATOMIC_ACQUIRE);
+		if (active > 0 && nr_idle == active) {
+			fast_forward(next_wake);
+		}
+		_time++;
+		if (active > 0) {
+			printf("Time slot %3lu\n", current_time());
+		}
+
+		/* Re-arm the barrier with devices still attached, then
+		 * let them continue their job */
+		nr_idle = 0;
+		next_wake = SLOT_NEVER;
+		__atomic_store_n(&nr_pending, active, __ATOMIC_RELEASE);
+		__atomic_xor_fetch(&slot_sense, 1, __ATOMIC_SEQ_CST);
+		if (__atomic_load_n(&nr_sleepers, __ATOMIC_SEQ_CST) > 0) {
+			futex_wake(&slot_sense, INT_MAX);
+		}
+		if (active == 0) {
+			break;
+		}
+	}
+	pthread_exit(args);
+}
+
+/* Wait for the timer to release the slot [timer_id] arrived in */
+static void slot_wait(struct timer_id_t * timer_id) {
+	int sense = timer_id->sense;
+	timer_id->sense = !sense;
+	if (spin_while(&slot_sense, sense)) {
+		return;
+	}
+	__atomic_add_fetch(&nr_sleepers, 1, __ATOMIC_SEQ_CST);
+	while (__atomic_load_n(&slot_sense, __ATOMIC_SEQ_CST) == sense) {
+		futex_wait(&slot_sense, sense);
+	}
+	__atomic_sub_fetch(&nr_sleepers, 1, __ATOMIC_ACQ_REL);
+}
+
+void next_slot(struct timer_id_t * timer_id) {
+	/* Tell to timer that we have done our job in current slot */
+	slot_arrive();
+
+	/* Wait for going to next slot */
+	slot_wait(timer_id);
+}
+
+void next_idle_slot(struct timer_id_t * timer_id, uint64_t wake) {
+	if (wake > current_time() + 1) {
+		/* Publish the wake-up before arriving at the barrier */
+		uint64_t old = __atomic_load_n(&next_wake, __ATOMIC_RELAXED);
+		while (wake < old && !__atomic_compare_exchange_n(&next_wake,
+				&old, wake, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+		__atomic_add_fetch(&nr_idle, 1, __ATOMIC_RELAXED);
+	}
+	next_slot(timer_id);
+}
+
+/*
+ * Parking
+ *
+ * A parking device first publishes EVENT_PARKING, then checks whether it
+ * may park. A waker queues its work first, then looks for parking
+ * devices, so at least one of them sees the other. Whoever moves the
+ * device out of EVENT_PARKED re-attaches it: the waker, which runs its
+ * own slot, so the timer cannot re-arm the barrier in between. That also
+ * lets the waker count the device as pending in the current slot
+ * (EVENT_WOKEN) rather than from the next one only.
+ */
+void park_event(struct timer_id_t * timer_id, int (*can_park)(void)) {
+	int state = EVENT_PARKING;
+	__atomic_store_n(&timer_id->parked, EVENT_PARKING, __ATOMIC_SEQ_CST);
+	__atomic_add_fetch(&nr_parked, 1, __ATOMIC_SEQ_CST);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (!can_park()) {
+		if (__atomic_compare_exchange_n(&timer_id->parked, &state,
+				EVENT_RUNNING, 0, __ATOMIC_SEQ_CST,
+				__ATOMIC_SEQ_CST)) {
+			__atomic_sub_fetch(&nr_parked, 1, __ATOMIC_SEQ_CST);
+		}
+		next_idle_slot(timer_id, SLOT_NEVER);
+		return;
+	}
+	if (!__atomic_compare_exchange_n(&timer_id->parked, &state,
+			EVENT_PARKED, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+		/* Woken up already */
+		next_idle_slot(timer_id, SLOT_NEVER);
+		return;
+	}
+
+	/* Leave the barrier as detach_event() does, then sleep */
+	__atomic_sub_fetch(&nr_active, 1, __ATOMIC_ACQ_REL);
+	slot_arrive();
+	while ((state = __atomic_load_n(&timer_id->parked, __ATOMIC_ACQUIRE))
+			== EVENT_PARKED || state == EVENT_WAKING) {
+		futex_wait(&timer_id->parked, state);
+	}
+	if (state == EVENT_WOKEN) {
+		/* Arrived in the current slot on behalf of the waker */
+		__atomic_store_n(&timer_id->parked, EVENT_RUNNING,
+				__ATOMIC_RELAXED);
+		return;
+	}
+	slot_wait(timer_id);
+}
+
+void unpark_event(struct timer_id_t * timer_id, int this_slot) {
+	int state = EVENT_PARKING;
+	if (__atomic_compare_exchange_n(&timer_id->parked, &state,
+			EVENT_RUNNING, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+		/* Still attached, it just does not park */
+		__atomic_sub_fetch(&nr_parked, 1, __ATOMIC_SEQ_CST);
+		return;
+	}
+	if (state != EVENT_PARKED || !__atomic_compare_exchange_n(
+			&timer_id->parked, &state, EVENT_WAKING, 0,
+			__ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+		return;
+	}
+	/* Re-attach it while the caller holds the current slot open. Once
+	 * pending in that slot too, the device steps it right away */
+	__atomic_sub_fetch(&nr_parked, 1, __ATOMIC_SEQ_CST);
+	timer_id->sense = __atomic_load_n(&slot_sense, __ATOMIC_ACQUIRE);
+	__atomic_add_fetch(&nr_active, 1, __ATOMIC_ACQ_REL);
+	if (this_slot) {
+		__atomic_add_fetch(&nr_pending, 1, __ATOMIC_ACQ_REL);
+	}
+	__atomic_store_n(&timer_id->parked,
+			this_slot ? EVENT_WOKEN : EVENT_RUNNING, __ATOMIC_RELEASE);
+	futex_wake(&timer_id->parked, 1);
+}
+
+int parked_events(void) {
+	return __atomic_load_n(&nr_parked, __ATOMIC_SEQ_CST);
+}
+
+void detach_event(struct timer_id_t * event) {
+	event->fsh = 1;
+	__atomic_sub_fetch(&nr_active, 1, __ATOMIC_ACQ_REL);
+	slot_arrive();
+}
+#else
+static void * timer_routine(void * args) {
+	while (!timer_stop) {
 		int fsh = 0;
 		int event = 0;
+		int idle = 0;
+		uint64_t wake = SLOT_NEVER;
 		/* Wait for all devices have done the job in current
 		 * time slot */
 		struct timer_id_container_t * temp;
@@ -36,14 +257,26 @@ static void * timer_routine(void * args) {
 			}
 			if (temp->id.fsh) {
 				fsh++;
+			}else if (temp->id.wake > _time + 1) {
+				idle++;
+				if (temp->id.wake < wake) {
+					wake = temp->id.wake;
+				}
 			}
 			event++;
 			pthread_mutex_unlock(&temp->id.event_lock);
 		}
 
-		/* Increase the time slot */
+		/* Increase the time slot, jump straight to the next
+		 * wake-up when every attached device is idle */
+		if (fsh < event && idle == event - fsh) {
+			fast_forward(wake);
+		}
 		_time++;
-		
+		if (fsh < event) {
+			printf("Time slot %3lu\n", current_time());
+		}
+
 		/* Let devices continue their job */
 		for (temp = dev_list; temp != NULL; temp = temp->next) {
 			pthread_mutex_lock(&temp->id.timer_lock);
@@ -59,8 +292,13 @@ static void * timer_routine(void * args) {
 }
 
 void next_slot(struct timer_id_t * timer_id) {
+	next_idle_slot(timer_id, 0);
+}
+
+void next_idle_slot(struct timer_id_t * timer_id, uint64_t wake) {
 	/* Tell to timer that we have done our job in current slot */
 	pthread_mutex_lock(&timer_id->event_lock);
+	timer_id->wake = wake;
 	timer_id->done = 1;
 	pthread_cond_signal(&timer_id->event_cond);
 	pthread_mutex_unlock(&timer_id->event_lock);
@@ -76,32 +314,61 @@ void next_slot(struct timer_id_t * timer_id) {
 	pthread_mutex_unlock(&timer_id->timer_lock);
 }
 
+void detach_event(struct timer_id_t * event) {
+	pthread_mutex_lock(&event->event_lock);
+	event->fsh = 1;
+	pthread_cond_signal(&event->event_cond);
+	pthread_mutex_unlock(&event->event_lock);
+}
+
+void park_event(struct timer_id_t * timer_id, int (*can_park)(void)) {
+	next_idle_slot(timer_id, SLOT_NEVER);
+}
+
+void unpark_event(struct timer_id_t * timer_id, int this_slot) {
+}
+
+int parked_events(void) {
+	return 0;
+}
+#endif
+
+void announce_slot(uint64_t slot) {
+	fast_forward(slot);
+	_time = slot;
+	printf("Time slot %3lu\n", current_time());
+}
+
 uint64_t current_time() {
 	return _time;
 }
 
 void start_timer() {
 	timer_started = 1;
+	/* Slots are announced before the devices are released into them */
+	printf("Time slot %3lu\n", current_time());
+#ifdef TIMER_SENSE_BARRIER
+	nr_pending = nr_active;
+	if (sysconf(_SC_NPROCESSORS_ONLN) > 1) {
+		barrier_spin = BARRIER_SPIN;
+	}
+#endif
 	pthread_create(&_timer, NULL, timer_routine, NULL);
 }
 
-void detach_event(struct timer_id_t * event) {
-	pthread_mutex_lock(&event->event_lock);
-	event->fsh = 1;
-	pthread_cond_signal(&event->event_cond);
-	pthread_mutex_unlock(&event->event_lock);
-}
-
 struct timer_id_t * attach_event() {
 	if (timer_started) {
 		return NULL;
 	}else{
 		struct timer_id_container_t * container =
 			(struct timer_id_container_t*)malloc(
-				sizeof(struct timer_id_container_t)		
+				sizeof(struct timer_id_container_t)
 			);
 		container->id.done = 0;
 		container->id.fsh = 0;
+		container->id.sense = 0;
+		container->id.wake = 0;
+		container->id.parked = EVENT_RUNNING;
 		pthread_cond_init(&container->id.event_cond, NULL);
 		pthread_mutex_init(&container->id.event_lock, NULL);
 		pthread_cond_init(&container->id.timer_cond, NULL);
@@ -113,6 +380,9 @@ struct timer_id_t * attach_event() {
 			container->next = dev_list;
 			dev_list = container;
 		}
+#ifdef TIMER_SENSE_BARRIER
+		nr_active++;
+#endif
 		return &(container->id);
 	}
 }
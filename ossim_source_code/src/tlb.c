@@ -0,0 +1,168 @@
+/*
+ * Per-CPU TLB
+ * mm/tlb.c
+ *
+ * A CPU looks up and fills only its own TLB. Shootdowns come from any
+ * CPU, so each TLB has a lock; it is hardly ever contended.
+ */
+
+#include "tlb.h"
+#include "os-cfg.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+struct tlb_entry {
+	uint32_t asid;
+	int pgn;		// -1 if the entry is invalid
+	uint32_t pte;
+	unsigned long used;	// Lookup count of the last hit, for LRU
+};
+
+struct tlb {
+	pthread_mutex_t lock;
+	struct tlb_entry entries[MM_TLB_SETS][MM_TLB_WAYS];
+	unsigned long clock;
+	unsigned long nr_hits;
+	unsigned long nr_misses;
+	unsigned long nr_shootdowns;	// Valid entries dropped by shootdowns
+};
+
+static struct tlb * tlbs;
+static int tlb_nr_cpus;
+
+void init_tlb(int num_cpus) {
+	int cpu, set, way;
+	tlb_nr_cpus = num_cpus;
+	tlbs = (struct tlb*)calloc(num_cpus, sizeof(struct tlb));
+	for (cpu = 0; cpu < num_cpus; cpu++) {
+		pthread_mutex_init(&tlbs[cpu].lock, NULL);
+		for (set = 0; set < MM_TLB_SETS; set++)
+			for (way = 0; way < MM_TLB_WAYS; way++)
+				tlbs[cpu].entries[set][way].pgn = -1;
+	}
+}
+
+static struct tlb_entry * tlb_set(struct tlb * tlb, int pgn) {
+	return tlb->entries[pgn % MM_TLB_SETS];
+}
+
+int tlb_lookup(int cpu, uint32_t asid, int pgn, uint32_t * pte) {
+	struct tlb * tlb = &tlbs[cpu];
+	struct tlb_entry * set = tlb_set(tlb, pgn);
+	int way;
+
+	pthread_mutex_lock(&tlb->lock);
+	tlb->clock++;
+	for (way = 0; way < MM_TLB_WAYS; way++) {
+		if (set[way].pgn == pgn && set[way].asid == asid) {
+			set[way].used = tlb->clock;
+			*pte = set[way].pte;
+			tlb->nr_hits++;
+			pthread_mutex_unlock(&tlb->lock);
+			return 0;
+		}
+	}
+	tlb->nr_misses++;
+	pthread_mutex_unlock(&tlb->lock);
+	return -1;
+}
+
+void tlb_fill(int cpu, uint32_t asid, int pgn, uint32_t pte) {
+	struct tlb * tlb = &tlbs[cpu];
+	struct tlb_entry * set = tlb_set(tlb, pgn);
+	struct tlb_entry * victim = &set[0];
+	int way;
+
+	pthread_mutex_lock(&tlb->lock);
+	/* Refresh the entry if it is there already, else take a free way or
+	 * the least recently used one */
+	for (way = 0; way < MM_TLB_WAYS; way++) {
+		if (set[way].pgn == pgn && set[way].asid == asid) {
+			victim = &set[way];
+			goto fill;
+		}
+	}
+	for (way = 0; way < MM_TLB_WAYS; way++) {
+		if (set[way].pgn < 0) {
+			victim = &set[way];
+			break;
+		}
+		if (set[way].used < victim->used)
+			victim = &set[way];
+	}
+fill:
+	victim->asid = asid;
+	victim->pgn = pgn;
+	victim->pte = pte;
+	victim->used = tlb->clock;
+	pthread_mutex_unlock(&tlb->lock);
+}
+
+void tlb_shootdown(uint32_t asid, int pgn) {
+	int cpu, way;
+	for (cpu = 0; cpu < tlb_nr_cpus; cpu++) {
+		struct tlb * tlb = &tlbs[cpu];
+		struct tlb_entry * set = tlb_set(tlb, pgn);
+		pthread_mutex_lock(&tlb->lock);
+		for (way = 0; way < MM_TLB_WAYS; way++) {
+			if (set[way].pgn == pgn && set[way].asid == asid) {
+				set[way].pgn = -1;
+				tlb->nr_shootdowns++;
+			}
+		}
+		pthread_mutex_unlock(&tlb->lock);
+	}
+}
+
+void tlb_flush_asid(uint32_t asid) {
+	int cpu, set, way;
+	for (cpu = 0; cpu < tlb_nr_cpus; cpu++) {
+		struct tlb * tlb = &tlbs[cpu];
+		pthread_mutex_lock(&tlb->lock);
+		for (set = 0; set < MM_TLB_SETS; set++)
+			for (way = 0; way < MM_TLB_WAYS; way++)
+				if (tlb->entries[set][way].asid == asid)
+					tlb->entries[set][way].pgn = -1;
+		pthread_mutex_unlock(&tlb->lock);
+	}
+}
+
+void finish_tlb(void) {
+	unsigned long hits = 0, misses = 0, shootdowns = 0;
+	int cpu;
+
+	for (cpu = 0; cpu < tlb_nr_cpus; cpu++) {
+		hits += tlbs[cpu].nr_hits;
+		misses += tlbs[cpu].nr_misses;
+	}
+	/* Nothing was translated, e.g. no process touched paged memory */
+	if (hits + misses == 0)
+		goto out;
+
+	printf("TLB (%d sets x %d ways per CPU)\n", MM_TLB_SETS, MM_TLB_WAYS);
+	printf("\t%3s %10s %10s %8s %11s\n", "CPU", "hits", "misses",
+		"hit rate", "shootdowns");
+	for (cpu = 0; cpu <= tlb_nr_cpus; cpu++) {
+		unsigned long h, m, s;
+		if (cpu < tlb_nr_cpus) {
+			h = tlbs[cpu].nr_hits;
+			m = tlbs[cpu].nr_misses;
+			s = tlbs[cpu].nr_shootdowns;
+			shootdowns += s;
+			printf("\t%3d", cpu);
+		}else{
+			h = hits;
+			m = misses;
+			s = shootdowns;
+			printf("\t%3s", "all");
+		}
+		printf(" %10lu %10lu %7.1f%% %11lu\n", h, m,
+			h + m ? 100.0 * h / (h + m) : 0.0, s);
+	}
+out:
+	for (cpu = 0; cpu < tlb_nr_cpus; cpu++)
+		pthread_mutex_destroy(&tlbs[cpu].lock);
+	free(tlbs);
+}
+